@@ -19,6 +19,7 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long request_cnt;     /* Number of driver requests. */
   };
 
 /* List of all block devices. */
@@ -113,6 +114,17 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Verifies that the CNT sectors starting at SECTOR are all
+   within BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
+{
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%zu, "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt, block->size);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -123,6 +135,7 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
   check_sector (block, sector);
   block->ops->read (block->aux, sector, buffer);
   block->read_cnt++;
+  block->request_cnt++;
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -137,6 +150,61 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
   ASSERT (block->type != BLOCK_FOREIGN);
   block->ops->write (block->aux, sector, buffer);
   block->write_cnt++;
+  block->request_cnt++;
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  If the driver supports it, this is a single request,
+   which is much cheaper than CNT calls to block_read().
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sectors (block, sector, cnt);
+  if (block->ops->read_multiple != NULL)
+    {
+      block->ops->read_multiple (block->aux, sector, cnt, buffer);
+      block->read_cnt += cnt;
+      block->request_cnt++;
+    }
+  else
+    for (i = 0; i < cnt; i++)
+      block_read (block, sector + i, (uint8_t *) buffer + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes,
+   in a single request if the driver supports it.  Returns after
+   the block device has acknowledged receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                      const void *buffer)
+{
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sectors (block, sector, cnt);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  if (block->ops->write_multiple != NULL)
+    {
+      block->ops->write_multiple (block->aux, sector, cnt, buffer);
+      block->write_cnt += cnt;
+      block->request_cnt++;
+    }
+  else
+    for (i = 0; i < cnt; i++)
+      block_write (block, sector + i,
+                   (const uint8_t *) buffer + i * BLOCK_SECTOR_SIZE);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -171,9 +239,9 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          printf ("%s (%s): %llu reads, %llu writes, %llu requests\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  block->read_cnt, block->write_cnt, block->request_cnt);
         }
     }
 }
@@ -200,6 +268,7 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->request_cnt = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
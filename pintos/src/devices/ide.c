@@ -34,6 +34,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +50,13 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+
+/* Most sectors one command can transfer.  The sector count
+   register holds 8 bits, with 0 meaning 256. */
+#define MAX_XFER_SECTORS 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +65,8 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int block_sectors;          /* Sectors per interrupt in multiple
+                                   mode, or 0 if not in multiple mode. */
   };
 
 /* An ATA channel (aka controller).
@@ -84,8 +94,9 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void set_multiple_mode (struct ata_disk *, int max_sectors);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -136,6 +147,7 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->block_sectors = 0;
         }
 
       /* Register interrupt handler. */
@@ -281,6 +293,11 @@ identify_ata_device (struct ata_disk *d)
     }
   input_sector (c, id);
 
+  /* Word 47 gives the most sectors READ MULTIPLE and WRITE
+     MULTIPLE can transfer per interrupt, or 0 if the disk does not
+     support them. */
+  set_multiple_mode (d, (uint8_t) id[47 * 2]);
+
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
@@ -309,6 +326,29 @@ identify_ata_device (struct ata_disk *d)
   partition_scan (block);
 }
 
+/* Sends a SET MULTIPLE MODE command to disk D to make it
+   transfer MAX_SECTORS sectors per interrupt in READ MULTIPLE and
+   WRITE MULTIPLE commands.  Sets D's block_sectors to MAX_SECTORS
+   if successful, or to 0 if D stays out of multiple mode, in which
+   case multi-sector transfers take one interrupt per sector. */
+static void
+set_multiple_mode (struct ata_disk *d, int max_sectors)
+{
+  struct channel *c = d->channel;
+
+  d->block_sectors = 0;
+  if (max_sectors == 0)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), max_sectors);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+    d->block_sectors = max_sectors;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,63 +377,135 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Each command transfers up to MAX_XFER_SECTORS sectors, taking
+   one interrupt per block of D's block_sectors sectors in
+   multiple mode and one per sector otherwise.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt, void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  size_t block_sectors = d->block_sectors > 0 ? d->block_sectors : 1;
+  uint8_t *p = buffer;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0)
+    {
+      size_t xfer_cnt = cnt < MAX_XFER_SECTORS ? cnt : MAX_XFER_SECTORS;
+      size_t done;
+
+      select_sector (d, sec_no, xfer_cnt);
+      issue_pio_command (c, (d->block_sectors > 0
+                             ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY));
+      for (done = 0; done < xfer_cnt; done += block_sectors)
+        {
+          size_t i;
+
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + done);
+          for (i = done; i < xfer_cnt && i < done + block_sectors; i++)
+            input_sector (c, p + i * BLOCK_SECTOR_SIZE);
+        }
+
+      sec_no += xfer_cnt;
+      p += xfer_cnt * BLOCK_SECTOR_SIZE;
+      cnt -= xfer_cnt;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes, in
+   the same way as ide_read_multiple().  Returns after the disk
+   has acknowledged receiving the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  size_t block_sectors = d->block_sectors > 0 ? d->block_sectors : 1;
+  const uint8_t *p = buffer;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      size_t xfer_cnt = cnt < MAX_XFER_SECTORS ? cnt : MAX_XFER_SECTORS;
+      size_t done;
+
+      select_sector (d, sec_no, xfer_cnt);
+      issue_pio_command (c, (d->block_sectors > 0
+                             ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY));
+      for (done = 0; done < xfer_cnt; done += block_sectors)
+        {
+          size_t i;
+
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + done);
+          for (i = done; i < xfer_cnt && i < done + block_sectors; i++)
+            output_sector (c, p + i * BLOCK_SECTOR_SIZE);
+          sema_down (&c->completion_wait);
+        }
+
+      sec_no += xfer_cnt;
+      p += xfer_cnt * BLOCK_SECTOR_SIZE;
+      cnt -= xfer_cnt;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d_, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multiple (d_, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multiple (d_, sec_no, 1, buffer);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
+   writes SEC_NO to the disk's sector selection registers and CNT,
+   at most MAX_XFER_SECTORS, to its sector count register.  (We
    use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_XFER_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_XFER_SECTORS ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
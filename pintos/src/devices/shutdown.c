@@ -5,12 +5,16 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/syscall.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #endif
 
@@ -120,8 +124,14 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+#ifdef USERPROG
+  syscall_print_stats ();
+#endif
+  palloc_print_stats ();
+  kmem_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  dcache_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
@@ -3,11 +3,12 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
-//#include "list.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 #define RECALC_FREQ 4
@@ -20,7 +21,17 @@
 
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
-//static struct list s_thread_list; //list that stores all sleeping threads
+
+/* Threads blocked in timer_sleep(), kept as a binary min-heap
+   ordered on awake_time, so that the timer interrupt only has to
+   look at sleep_heap[0] to know whether anyone is due.  The heap
+   starts out in static storage and moves to the malloc() arena
+   when it outgrows it.  Accessed only with interrupts off. */
+#define SLEEP_HEAP_INIT 32
+static struct thread *sleep_heap_init[SLEEP_HEAP_INIT];
+static struct thread **sleep_heap = sleep_heap_init;
+static size_t sleep_cnt;
+static size_t sleep_capacity = SLEEP_HEAP_INIT;
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
@@ -31,6 +42,9 @@ static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static enum intr_level sleep_heap_reserve (void);
+static void sleep_heap_push (struct thread *);
+static struct thread *sleep_heap_pop (void);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -39,7 +53,6 @@ timer_init (void)
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
- // list_init(&s_thread_list);
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -90,55 +103,29 @@ timer_elapsed (int64_t then)
 
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The calling thread blocks until the timer interrupt that
+   brings the tick count up to its wakeup time, instead of
+   spinning on thread_yield(). */
 void
 timer_sleep (int64_t ticks) 
-{/*
-	ASSERT (intr_get_level () == INTR_ON);
-
- 	if (ticks > 0){
-
-		enum intr_level old_level = intr_disable();
-		thread_current()->awake_time = timer_ticks() + ticks;
-		list_insert_ordered(&s_thread_list, &thread_current()->elem, 
-						(list_less_func *) &compare_wakeup_time, NULL);
+{
+  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
-		thread_block();
-		intr_set_level(old_level);
-	}*/
-	int64_t start = timer_ticks();
-	ASSERT(intr_get_level()==INTR_ON);
-	while(timer_elapsed(start)<ticks)
-		thread_yield();
+  ASSERT (intr_get_level () == INTR_ON);
+  if (ticks <= 0)
+    return;
 
+  old_level = sleep_heap_reserve ();
+  cur->awake_time = start + ticks;
+  sleep_heap_push (cur);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
-
-
-
-
-  	//here we should check for the threads because if the case is idle, we
-  	//actually do not need the wait ticks
-/*	if (ticks > 0)
-	{
- 		 enum intr_level old_level_disable = intr_disable();
-  		// get current thread
- 		 struct thread *curr_thr = thread_current();
-  		// calculate awake time
-  		curr_thr->awake_time = timer_ticks() + ticks;
-  		// insert to sleeping list 
-  		//--- here we should check for the function passing variables because I think that it is not doing smth we 
-  		// want 
- 		 list_insert_ordered(&s_thread_list, &curr_thr->s_elem, (list_less_func *) &compare_wakeup_time, NULL);
-  		//---what is sema_down is exactly doing
- 		 //sema_down(&curr_thr->sema_s);
-		thread_block();
-  		intr_set_level(old_level_disable);
-	}
-*/
-
-
-
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
    turned on. */
 void
@@ -209,53 +196,116 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
-/* Timer interrupt handler. */
-//----this is our old timer interrupt
-/*static void
+/* Timer interrupt handler.  Wakes up every sleeping thread
+   whose wakeup time has arrived; when nobody is due this costs a
+   single comparison. */
+static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  struct list_elem *e = list_begin(&s_thread_list);
-  struct thread *thr = list_entry(e, struct thread, timer_elem);
-
-  while( (timer_ticks() >= thr->awake_time) && (e != list_end(&s_thread_list) ))
-  {
-    sema_up(&thr->sema_s);
-    e = list_remove(e);
-    thr = list_entry(e, struct thread, timer_elem);
-  }
+  bool woke = false;
 
   ticks++;
   thread_tick ();
-}*/
 
-//here is the new implementation of the interrupt handler 
-static void
-timer_interrupt (struct intr_frame *args UNUSED)
+  while (sleep_cnt > 0 && sleep_heap[0]->awake_time <= ticks)
+    {
+      thread_unblock (sleep_heap_pop ());
+      woke = true;
+    }
+  if (woke)
+    check_priority ();
+}
+
+/* Makes sure the sleep heap has room for one more thread,
+   growing it if necessary.  Returns with interrupts disabled,
+   passing back the interrupt level on entry. */
+static enum intr_level
+sleep_heap_reserve (void)
 {
-	/*struct list_elem *e;
-	struct thread *thr;
-	ticks++;
-	thread_tick();
-	//here we are getting particular element 
-	e = list_begin(&s_thread_list);
-	while(e != list_end(&s_thread_list))
-  	{
-		thr = list_entry(e, struct thread, elem);
-		//sema_up(&thr->sema_s);
-		if(ticks < thr->awake_time) break;
-		
-		list_remove(e);
-		thread_unblock(thr);
-		e = list_begin(&s_thread_list);
-	}
-    check_priority();*/
-	ticks++;
-	thread_tick();
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      size_t capacity = sleep_capacity;
+      struct thread **new_heap, **old_heap;
+
+      if (sleep_cnt < capacity)
+        return old_level;
+      intr_set_level (old_level);
+
+      /* Allocate with interrupts on, then swap the new array in
+         atomically.  If another thread grew the heap meanwhile,
+         just throw our array away and try again. */
+      new_heap = malloc (2 * capacity * sizeof *new_heap);
+      if (new_heap == NULL)
+        PANIC ("out of memory growing the sleep queue");
+
+      old_level = intr_disable ();
+      old_heap = new_heap;
+      if (sleep_capacity == capacity)
+        {
+          memcpy (new_heap, sleep_heap, sleep_cnt * sizeof *sleep_heap);
+          old_heap = sleep_heap;
+          sleep_heap = new_heap;
+          sleep_capacity = 2 * capacity;
+        }
+      intr_set_level (old_level);
+
+      if (old_heap != sleep_heap_init)
+        free (old_heap);
+    }
 }
 
+/* Adds T to the sleep heap, which must have room for it.
+   Interrupts must be off. */
+static void
+sleep_heap_push (struct thread *t)
+{
+  size_t i = sleep_cnt++;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (sleep_cnt <= sleep_capacity);
 
+  while (i > 0)
+    {
+      size_t parent = (i - 1) / 2;
+      if (sleep_heap[parent]->awake_time <= t->awake_time)
+        break;
+      sleep_heap[i] = sleep_heap[parent];
+      i = parent;
+    }
+  sleep_heap[i] = t;
+}
 
+/* Removes and returns the thread with the earliest wakeup time
+   from the sleep heap, which must not be empty.  Interrupts must
+   be off. */
+static struct thread *
+sleep_heap_pop (void)
+{
+  struct thread *min, *last;
+  size_t i = 0;
 
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (sleep_cnt > 0);
+
+  min = sleep_heap[0];
+  last = sleep_heap[--sleep_cnt];
+  for (;;)
+    {
+      size_t child = 2 * i + 1;
+      if (child >= sleep_cnt)
+        break;
+      if (child + 1 < sleep_cnt
+          && sleep_heap[child + 1]->awake_time < sleep_heap[child]->awake_time)
+        child++;
+      if (last->awake_time <= sleep_heap[child]->awake_time)
+        break;
+      sleep_heap[i] = sleep_heap[child];
+      i = child;
+    }
+  sleep_heap[i] = last;
+  return min;
+}
 
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
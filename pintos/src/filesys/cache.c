@@ -0,0 +1,462 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Buffer cache for file system sectors.
+
+   All reads and writes of fs_device by the file system go
+   through a fixed set of CACHE_SIZE sector buffers.  Buffers are
+   replaced using the clock algorithm.  Modified buffers are
+   written back lazily: when they are evicted, periodically by a
+   flusher thread, and by cache_flush() at shutdown.  A
+   read-ahead thread fetches sectors that are likely to be read
+   next in the background.
+
+   Runs of consecutive sectors are read and written with single
+   multi-sector device requests where possible: cache_prefetch()
+   reads a run that is about to be used, and cache_flush() writes
+   dirty neighbours together.  Both transfer through one bounce
+   buffer, serialized by run_lock.
+
+   Locking: cache_lock protects the mapping from sectors to
+   entries and each entry's bookkeeping (SECTOR, IN_USE,
+   PIN_CNT, ACCESSED, WRITING_BACK).  An entry's own LOCK
+   protects its DATA, LOADED, and DIRTY and is held across disk
+   I/O on the entry, so that cache_lock never is.  An entry is
+   only ever reassigned to a new sector while its PIN_CNT is 0,
+   that is, while nobody holds or waits for its LOCK.  A thread
+   holds more than one entry's LOCK only with run_lock held, and
+   then acquires them in increasing sector order. */
+
+/* Number of sectors in the cache. */
+#define CACHE_SIZE 64
+
+/* Timer ticks between write-behind passes. */
+#define WRITE_BEHIND_TICKS TIMER_FREQ
+
+/* Maximum number of outstanding read-ahead requests. */
+#define READ_AHEAD_MAX 16
+
+/* A request to read CNT sectors starting at SECTOR ahead. */
+struct read_ahead
+  {
+    block_sector_t sector;
+    size_t cnt;
+  };
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;      /* Sector held, if IN_USE. */
+    bool in_use;                /* Holds a sector? */
+    int pin_cnt;                /* Threads using or waiting for entry. */
+    bool accessed;              /* Used since the clock hand passed? */
+    bool writing_back;          /* Writing OLD_SECTOR back to disk? */
+    block_sector_t old_sector;  /* Sector being written back. */
+
+    struct lock lock;           /* Serializes access to DATA. */
+    bool loaded;                /* DATA holds SECTOR's contents? */
+    bool dirty;                 /* DATA newer than disk? */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static struct condition cache_cond;     /* Entry unpinned or written back. */
+static size_t clock_hand;
+
+/* Bounce buffer for multi-sector transfers, CACHE_RUN_MAX
+   sectors long. */
+static uint8_t *run_buf;
+static struct lock run_lock;
+
+/* Read-ahead request queue, a ring buffer. */
+static struct read_ahead read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_head;
+static size_t read_ahead_cnt;
+static struct lock read_ahead_lock;
+static struct condition read_ahead_cond;
+
+static thread_func read_ahead_daemon NO_RETURN;
+static thread_func write_behind_daemon NO_RETURN;
+static struct cache_entry *cache_lookup (block_sector_t, bool *busy);
+static struct cache_entry *cache_evict (void);
+static struct cache_entry *cache_get (block_sector_t, bool overwrite);
+static void cache_put (struct cache_entry *);
+static bool claim (struct cache_entry *, block_sector_t);
+static void finish_write_back (struct cache_entry *);
+
+/* Initializes the buffer cache and starts its helper threads. */
+void
+cache_init (void)
+{
+  size_t page_cnt = CACHE_SIZE * BLOCK_SECTOR_SIZE / PGSIZE;
+  uint8_t *base = palloc_get_multiple (PAL_ASSERT, page_cnt);
+  size_t i;
+
+  lock_init (&cache_lock);
+  cond_init (&cache_cond);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      e->in_use = false;
+      e->pin_cnt = 0;
+      e->accessed = false;
+      e->writing_back = false;
+      lock_init (&e->lock);
+      e->loaded = false;
+      e->dirty = false;
+      e->data = base + i * BLOCK_SECTOR_SIZE;
+    }
+
+  run_buf = palloc_get_multiple (PAL_ASSERT,
+                                 CACHE_RUN_MAX * BLOCK_SECTOR_SIZE / PGSIZE);
+  lock_init (&run_lock);
+
+  lock_init (&read_ahead_lock);
+  cond_init (&read_ahead_cond);
+  thread_create ("read-ahead", PRI_DEFAULT, read_ahead_daemon, NULL);
+  thread_create ("write-behind", PRI_DEFAULT, write_behind_daemon, NULL);
+}
+
+/* Reads SIZE bytes starting at byte offset OFS within SECTOR of
+   the file system device into BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, false);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR of the file system
+   device, starting at byte offset OFS within the sector.  The
+   data reaches the disk later. */
+void
+cache_write (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  bool overwrite = ofs == 0 && size == BLOCK_SECTOR_SIZE;
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, overwrite);
+  memcpy (e->data + ofs, buffer, size);
+  e->loaded = true;
+  e->dirty = true;
+  cache_put (e);
+}
+
+/* Asks for the CNT sectors starting at SECTOR to be brought into
+   the cache in the background, because they are likely to be
+   read soon.  The request is dropped if too many are already
+   pending. */
+void
+cache_read_ahead (block_sector_t sector, size_t cnt)
+{
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_MAX)
+    {
+      size_t tail = (read_ahead_head + read_ahead_cnt) % READ_AHEAD_MAX;
+      read_ahead_queue[tail].sector = sector;
+      read_ahead_queue[tail].cnt = cnt;
+      read_ahead_cnt++;
+      cond_signal (&read_ahead_cond, &read_ahead_lock);
+    }
+  lock_release (&read_ahead_lock);
+}
+
+/* Brings the sectors in the range of CNT sectors starting at
+   SECTOR into the cache with a single device request.  Sectors at
+   the start of the range that are already cached are skipped, and
+   the request ends before the next one that is.  At most
+   CACHE_RUN_MAX sectors are read, and fewer if the cache has too
+   few entries to spare. */
+void
+cache_prefetch (block_sector_t sector, size_t cnt)
+{
+  struct cache_entry *run[CACHE_RUN_MAX];
+  bool write_back[CACHE_RUN_MAX];
+  size_t n, i;
+  bool busy;
+
+  lock_acquire (&run_lock);
+
+  /* Claim an entry for each sector to read. */
+  lock_acquire (&cache_lock);
+  while (cnt > 0 && (cache_lookup (sector, &busy) != NULL || busy))
+    {
+      sector++;
+      cnt--;
+    }
+  for (n = 0; n < cnt && n < CACHE_RUN_MAX; n++)
+    {
+      struct cache_entry *e;
+
+      if (cache_lookup (sector + n, &busy) != NULL || busy)
+        break;
+      e = cache_evict ();
+      if (e == NULL)
+        break;
+      write_back[n] = claim (e, sector + n);
+      e->pin_cnt++;
+      e->accessed = true;
+      run[n] = e;
+    }
+  lock_release (&cache_lock);
+
+  if (n > 0)
+    {
+      for (i = 0; i < n; i++)
+        {
+          lock_acquire (&run[i]->lock);
+          if (write_back[i])
+            finish_write_back (run[i]);
+        }
+
+      /* Another thread may have loaded, and even modified, an
+         entry before we locked it. */
+      block_read_multiple (fs_device, sector, n, run_buf);
+      for (i = 0; i < n; i++)
+        {
+          if (!run[i]->loaded)
+            {
+              memcpy (run[i]->data, run_buf + i * BLOCK_SECTOR_SIZE,
+                      BLOCK_SECTOR_SIZE);
+              run[i]->loaded = true;
+            }
+          cache_put (run[i]);
+        }
+    }
+  lock_release (&run_lock);
+}
+
+/* Writes every modified sector in the cache to disk.  Modified
+   sectors that are consecutive on disk are written together, up
+   to CACHE_RUN_MAX at a time. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  lock_acquire (&run_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      struct cache_entry *run[CACHE_RUN_MAX];
+      size_t n = 0, j, k;
+
+      /* Gather E and the modified entries for the sectors that
+         follow it. */
+      lock_acquire (&cache_lock);
+      if (e->in_use && e->dirty && !e->writing_back)
+        {
+          e->pin_cnt++;
+          run[n++] = e;
+          while (n < CACHE_RUN_MAX)
+            {
+              bool busy;
+              struct cache_entry *f = cache_lookup (e->sector + n, &busy);
+              if (f == NULL || !f->dirty || f->writing_back)
+                break;
+              f->pin_cnt++;
+              run[n++] = f;
+            }
+        }
+      lock_release (&cache_lock);
+      if (n == 0)
+        continue;
+
+      /* Write the part of the run that is still modified. */
+      for (j = 0; j < n; j++)
+        lock_acquire (&run[j]->lock);
+      for (k = 0; k < n && run[k]->dirty; k++)
+        memcpy (run_buf + k * BLOCK_SECTOR_SIZE, run[k]->data,
+                BLOCK_SECTOR_SIZE);
+      block_write_multiple (fs_device, e->sector, k, run_buf);
+      for (j = 0; j < n; j++)
+        {
+          if (j < k)
+            run[j]->dirty = false;
+          cache_put (run[j]);
+        }
+    }
+  lock_release (&run_lock);
+}
+
+/* Returns the entry holding SECTOR, if any, otherwise a null
+   pointer.  Sets *BUSY to true if SECTOR is still being written
+   back from an entry that has been reassigned.  cache_lock must
+   be held. */
+static struct cache_entry *
+cache_lookup (block_sector_t sector, bool *busy)
+{
+  size_t i;
+
+  *busy = false;
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      if (e->in_use && e->sector == sector)
+        return e;
+      if (e->writing_back && e->old_sector == sector)
+        *busy = true;
+    }
+  return NULL;
+}
+
+/* Chooses an unpinned entry to reuse with the clock algorithm
+   and returns it, or returns a null pointer if every entry is
+   pinned.  cache_lock must be held. */
+static struct cache_entry *
+cache_evict (void)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (e->pin_cnt > 0 || e->writing_back)
+        continue;
+      if (!e->in_use || !e->accessed)
+        return e;
+      e->accessed = false;
+    }
+  return NULL;
+}
+
+/* Returns the entry for SECTOR, pinned and with its lock held,
+   bringing it into the cache if necessary.  If OVERWRITE is
+   true, the caller is about to replace the whole sector, so its
+   old contents are not read from disk.  Release the entry with
+   cache_put(). */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool overwrite)
+{
+  struct cache_entry *e;
+  bool write_back = false;
+  bool busy;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      e = cache_lookup (sector, &busy);
+      if (e != NULL)
+        break;
+      if (!busy)
+        {
+          e = cache_evict ();
+          if (e != NULL)
+            {
+              write_back = claim (e, sector);
+              break;
+            }
+        }
+      cond_wait (&cache_cond, &cache_lock);
+    }
+  e->pin_cnt++;
+  e->accessed = true;
+  lock_release (&cache_lock);
+
+  lock_acquire (&e->lock);
+  if (write_back)
+    finish_write_back (e);
+  if (!e->loaded && !overwrite)
+    {
+      block_read (fs_device, sector, e->data);
+      e->loaded = true;
+    }
+  return e;
+}
+
+/* Takes over entry E, just chosen by cache_evict(), for SECTOR.
+   Returns true if E holds dirty data for its old sector, which
+   the caller must write back with finish_write_back() once it
+   holds E's lock; until that is done nobody may load the old
+   sector afresh.  cache_lock must be held. */
+static bool
+claim (struct cache_entry *e, block_sector_t sector)
+{
+  bool write_back = e->in_use && e->dirty;
+
+  e->old_sector = e->sector;
+  e->writing_back = write_back;
+  e->in_use = true;
+  e->sector = sector;
+  e->loaded = false;
+  return write_back;
+}
+
+/* Writes the data E holds for its old sector back to disk, as
+   claim() asked.  E's lock must be held. */
+static void
+finish_write_back (struct cache_entry *e)
+{
+  block_write (fs_device, e->old_sector, e->data);
+  e->dirty = false;
+
+  lock_acquire (&cache_lock);
+  e->writing_back = false;
+  cond_broadcast (&cache_cond, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Releases entry E obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  if (--e->pin_cnt == 0)
+    cond_broadcast (&cache_cond, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Read-ahead thread.  Brings requested sectors into the cache. */
+static void
+read_ahead_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct read_ahead r;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_cond, &read_ahead_lock);
+      r = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_MAX;
+      read_ahead_cnt--;
+      lock_release (&read_ahead_lock);
+
+      cache_prefetch (r.sector, r.cnt);
+    }
+}
+
+/* Write-behind thread.  Periodically writes modified sectors
+   back to disk, so that little is lost if the machine stops
+   without an orderly shutdown.  The free map batches its own
+   changes in memory, so it is flushed into the cache first. */
+static void
+write_behind_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (WRITE_BEHIND_TICKS);
+      free_map_flush ();
+      cache_flush ();
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Most sectors cache_prefetch() reads in one request. */
+#define CACHE_RUN_MAX 16
+
+void cache_init (void);
+void cache_read (block_sector_t, void *buffer, int ofs, int size);
+void cache_write (block_sector_t, const void *buffer, int ofs, int size);
+void cache_read_ahead (block_sector_t, size_t cnt);
+void cache_prefetch (block_sector_t, size_t cnt);
+void cache_flush (void);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,205 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Directory entry cache ("dcache").
+
+   Remembers the results of recent directory lookups, keyed on the
+   sector of the directory's inode and the name looked up, so that
+   looking up the same name again does not read the directory.
+   Lookups that found nothing are remembered too, as negative
+   entries, since opening a name that does not exist is as common
+   as opening one that does.
+
+   The directory code keeps the cache consistent: it updates the
+   entry for a name whenever it adds or removes that name, while
+   holding the directory's lock, and purges a directory's entries
+   when a new directory is created in its inode sector.  The cache
+   holds at most DCACHE_SIZE entries and evicts the least recently
+   used. */
+
+/* Number of entries in the cache. */
+#define DCACHE_SIZE 128
+
+/* A cached lookup result. */
+struct dcache_entry
+  {
+    block_sector_t dir;                 /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name looked up. */
+    block_sector_t inode_sector;        /* Result, or DCACHE_NEGATIVE. */
+    struct hash_elem hash_elem;         /* Element in dcache_table. */
+    struct list_elem list_elem;         /* Element in LRU or free list. */
+  };
+
+static struct dcache_entry entries[DCACHE_SIZE];
+static struct hash dcache_table;        /* Entries in use, by key. */
+static struct list lru_list;            /* Entries in use, most recent first. */
+static struct list free_list;           /* Entries not in use. */
+static struct lock dcache_lock;         /* Protects all of the above. */
+
+/* Statistics. */
+static long long hit_cnt;               /* Positive entries found. */
+static long long negative_hit_cnt;      /* Negative entries found. */
+static long long miss_cnt;              /* Names not in the cache. */
+
+static struct dcache_entry *find (block_sector_t dir, const char *name);
+static hash_hash_func dcache_hash;
+static hash_less_func dcache_less;
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  lock_init (&dcache_lock);
+  list_init (&lru_list);
+  list_init (&free_list);
+  if (!hash_init (&dcache_table, dcache_hash, dcache_less, NULL))
+    PANIC ("dcache: hash table creation failed");
+  for (i = 0; i < DCACHE_SIZE; i++)
+    list_push_back (&free_list, &entries[i].list_elem);
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If the result is cached, stores it in *INODE_SECTOR (which is
+   DCACHE_NEGATIVE if there is no such name) and returns true.
+   Otherwise returns false. */
+bool
+dcache_lookup (block_sector_t dir, const char *name,
+               block_sector_t *inode_sector)
+{
+  struct dcache_entry *e;
+
+  lock_acquire (&dcache_lock);
+  e = find (dir, name);
+  if (e != NULL)
+    {
+      list_remove (&e->list_elem);
+      list_push_front (&lru_list, &e->list_elem);
+      *inode_sector = e->inode_sector;
+      if (e->inode_sector != DCACHE_NEGATIVE)
+        hit_cnt++;
+      else
+        negative_hit_cnt++;
+    }
+  else
+    miss_cnt++;
+  lock_release (&dcache_lock);
+
+  return e != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector DIR
+   refers to the inode in INODE_SECTOR, or, if INODE_SECTOR is
+   DCACHE_NEGATIVE, that there is no such name.  Names too long to
+   exist are not cached. */
+void
+dcache_insert (block_sector_t dir, const char *name,
+               block_sector_t inode_sector)
+{
+  struct dcache_entry *e;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  e = find (dir, name);
+  if (e != NULL)
+    list_remove (&e->list_elem);
+  else
+    {
+      if (!list_empty (&free_list))
+        e = list_entry (list_pop_front (&free_list),
+                        struct dcache_entry, list_elem);
+      else
+        {
+          e = list_entry (list_pop_back (&lru_list),
+                          struct dcache_entry, list_elem);
+          hash_delete (&dcache_table, &e->hash_elem);
+        }
+      e->dir = dir;
+      strlcpy (e->name, name, sizeof e->name);
+      hash_insert (&dcache_table, &e->hash_elem);
+    }
+  e->inode_sector = inode_sector;
+  list_push_front (&lru_list, &e->list_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every entry for the directory whose inode is in sector
+   DIR. */
+void
+dcache_purge_dir (block_sector_t dir)
+{
+  struct list_elem *elem, *next;
+
+  lock_acquire (&dcache_lock);
+  for (elem = list_begin (&lru_list); elem != list_end (&lru_list);
+       elem = next)
+    {
+      struct dcache_entry *e = list_entry (elem, struct dcache_entry,
+                                           list_elem);
+      next = list_next (elem);
+      if (e->dir == dir)
+        {
+          hash_delete (&dcache_table, &e->hash_elem);
+          list_remove (&e->list_elem);
+          list_push_back (&free_list, &e->list_elem);
+        }
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Prints directory entry cache statistics. */
+void
+dcache_print_stats (void)
+{
+  printf ("Dcache: %lld hits, %lld negative hits, %lld misses\n",
+          hit_cnt, negative_hit_cnt, miss_cnt);
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer if there is
+   none.  dcache_lock must be held. */
+static struct dcache_entry *
+find (block_sector_t dir, const char *name)
+{
+  struct dcache_entry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dcache_table, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/* Returns a hash value for entry E. */
+static unsigned
+dcache_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct dcache_entry *e = hash_entry (e_, struct dcache_entry,
+                                             hash_elem);
+  return hash_string (e->name) ^ hash_int (e->dir);
+}
+
+/* Returns true if entry A precedes entry B. */
+static bool
+dcache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dcache_entry *a = hash_entry (a_, struct dcache_entry,
+                                             hash_elem);
+  const struct dcache_entry *b = hash_entry (b_, struct dcache_entry,
+                                             hash_elem);
+
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
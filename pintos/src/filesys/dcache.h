@@ -0,0 +1,19 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Stands for "no such entry" in a negative dcache entry.  No
+   file's inode is in sector 0, which holds the free map's. */
+#define DCACHE_NEGATIVE 0
+
+void dcache_init (void);
+bool dcache_lookup (block_sector_t dir, const char *name,
+                    block_sector_t *inode_sector);
+void dcache_insert (block_sector_t dir, const char *name,
+                    block_sector_t inode_sector);
+void dcache_purge_dir (block_sector_t dir);
+void dcache_print_stats (void);
+
+#endif /* filesys/dcache.h */
@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -10,7 +12,7 @@
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
-    off_t pos;                          /* Current position. */
+    off_t pos;                          /* Index of next entry to read. */
   };
 
 /* A single directory entry. */
@@ -21,12 +23,131 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* On-disk directory format.
+
+   A directory file is a header sector followed by BUCKET_CNT
+   buckets of one sector each, where BUCKET_CNT is a power of 2.
+   Each name hashes to a "home" bucket.  An entry goes in the first
+   bucket with a free slot, starting from its home bucket and
+   wrapping around; a bucket that is full when an insertion passes
+   over it is marked as overflowed.  A lookup therefore reads the
+   home bucket and goes on to the next one only while the bucket
+   it has read is marked, which usually means reading one bucket.
+
+   The header also records the sector of the parent directory's
+   inode, which is how "..", never stored as an entry, is looked
+   up.  The root directory is its own parent.
+
+   When an entry's home bucket is full and the directory is at
+   least half full, the number of buckets is doubled and every
+   entry is rehashed, which also clears stale overflow marks left
+   by removed entries. */
+
+/* Identifies a directory header. */
+#define DIR_MAGIC 0x48524944
+
+/* Number of entries in a bucket. */
+#define BUCKET_ENTRIES 25
+
+/* Directory header, at the start of the header sector.  The rest
+   of that sector is not used. */
+struct dir_header
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t bucket_cnt;                /* Number of buckets. */
+    uint32_t entry_cnt;                 /* Number of entries in use. */
+    block_sector_t parent;              /* Parent directory's inode. */
+  };
+
+/* A bucket of directory entries.  Must be exactly
+   BLOCK_SECTOR_SIZE bytes. */
+struct dir_bucket
+  {
+    struct dir_entry entries[BUCKET_ENTRIES];
+    uint32_t overflow;                  /* Was full when passed over? */
+    uint8_t unused[8];                  /* Not used. */
+  };
+
+/* Returns the byte offset of bucket IDX in a directory file. */
+static off_t
+bucket_ofs (size_t idx)
+{
+  return (off_t) (idx + 1) * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the home bucket of NAME in a directory with BUCKET_CNT
+   buckets. */
+static size_t
+home_bucket (const char *name, size_t bucket_cnt)
+{
+  return hash_string (name) & (bucket_cnt - 1);
+}
+
+/* Reads INODE's directory header into *H.
+   Returns true if successful, false on failure. */
+static bool
+read_header (struct inode *inode, struct dir_header *h)
+{
+  return (inode_read_at (inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_MAGIC);
+}
+
+/* Writes *H as INODE's directory header.
+   Returns true if successful, false on failure. */
+static bool
+write_header (struct inode *inode, const struct dir_header *h)
+{
+  return inode_write_at (inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Reads bucket IDX of directory INODE into *B.
+   Returns true if successful, false on failure. */
+static bool
+read_bucket (struct inode *inode, size_t idx, struct dir_bucket *b)
+{
+  return inode_read_at (inode, b, sizeof *b, bucket_ofs (idx)) == sizeof *b;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose parent directory's inode is in sector
+   PARENT.  Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_header h;
+  struct inode *inode;
+  size_t bucket_cnt = 1;
+  bool success = false;
+
+  /* If this assertion fails, a bucket is not exactly one sector
+     in size, and you should fix that. */
+  ASSERT (sizeof (struct dir_bucket) == BLOCK_SECTOR_SIZE);
+
+  /* Start out no more than half full. */
+  while (bucket_cnt * BUCKET_ENTRIES < 2 * entry_cnt)
+    bucket_cnt *= 2;
+
+  h.magic = DIR_MAGIC;
+  h.bucket_cnt = bucket_cnt;
+  h.entry_cnt = 0;
+  h.parent = parent;
+
+  /* The buckets start out zeroed, with every slot free. */
+  if (inode_create (sector, bucket_ofs (bucket_cnt), true))
+    {
+      inode = inode_open (sector);
+      if (inode != NULL)
+        {
+          success = write_header (inode, &h);
+          inode_close (inode);
+        }
+    }
+
+  /* Anything cached about a directory that used to be in SECTOR
+     is stale now. */
+  if (success)
+    dcache_purge_dir (sector);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -83,51 +204,211 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
+/* Sets DIR's position, the index of the next entry dir_readdir()
+   examines, to POS. */
+void
+dir_seek (struct dir *dir, off_t pos)
+{
+  ASSERT (pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns DIR's position. */
+off_t
+dir_tell (struct dir *dir)
+{
+  return dir->pos;
+}
+
+/* Searches DIR for a file with the given NAME, reading its buckets
+   into B.  DIR's header is H.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   The caller must hold DIR's directory lock. */
 static bool
-lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+lookup (const struct dir *dir, const struct dir_header *h,
+        const char *name, struct dir_bucket *b,
+        struct dir_entry *ep, off_t *ofsp)
 {
-  struct dir_entry e;
-  size_t ofs;
-  
+  size_t idx, i, j;
+
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+  idx = home_bucket (name, h->bucket_cnt);
+  for (i = 0; i < h->bucket_cnt; i++)
+    {
+      if (!read_bucket (dir->inode, idx, b))
+        return false;
+      for (j = 0; j < BUCKET_ENTRIES; j++)
+        {
+          struct dir_entry *e = &b->entries[j];
+          if (e->in_use && !strcmp (name, e->name))
+            {
+              if (ep != NULL)
+                *ep = *e;
+              if (ofsp != NULL)
+                *ofsp = bucket_ofs (idx) + j * sizeof *e;
+              return true;
+            }
+        }
+      if (!b->overflow)
+        break;
+      idx = (idx + 1) & (h->bucket_cnt - 1);
+    }
   return false;
 }
 
+/* Stores E in the first free slot of directory INODE along the
+   probe sequence for E's name, marking full buckets passed over as
+   overflowed.  INODE's header is H, whose entry count is not
+   updated.  B is a buffer for buckets.
+   Returns true if successful, false if there is no free slot or a
+   disk error occurs. */
+static bool
+insert (struct inode *inode, const struct dir_header *h,
+        const struct dir_entry *e, struct dir_bucket *b)
+{
+  size_t idx, i, j;
+
+  idx = home_bucket (e->name, h->bucket_cnt);
+  for (i = 0; i < h->bucket_cnt; i++)
+    {
+      if (!read_bucket (inode, idx, b))
+        return false;
+      for (j = 0; j < BUCKET_ENTRIES; j++)
+        if (!b->entries[j].in_use)
+          {
+            off_t ofs = bucket_ofs (idx) + j * sizeof *e;
+            return inode_write_at (inode, e, sizeof *e, ofs) == sizeof *e;
+          }
+      if (!b->overflow)
+        {
+          b->overflow = 1;
+          if (inode_write_at (inode, b, sizeof *b, bucket_ofs (idx))
+              != sizeof *b)
+            return false;
+        }
+      idx = (idx + 1) & (h->bucket_cnt - 1);
+    }
+  return false;
+}
+
+/* Returns true if NAME's home bucket in directory INODE, whose
+   header is H, has no free slot.  B is a buffer for buckets. */
+static bool
+home_bucket_full (struct inode *inode, const struct dir_header *h,
+                  const char *name, struct dir_bucket *b)
+{
+  size_t j;
+
+  if (!read_bucket (inode, home_bucket (name, h->bucket_cnt), b))
+    return false;
+  for (j = 0; j < BUCKET_ENTRIES; j++)
+    if (!b->entries[j].in_use)
+      return false;
+  return true;
+}
+
+/* Doubles the number of buckets in directory INODE, whose header
+   is H, and rehashes its entries.  Updates *H.  B is a buffer for
+   buckets.  Returns true if successful, false on failure.  Running
+   out of memory or disk space leaves the directory unchanged. */
+static bool
+grow (struct inode *inode, struct dir_header *h, struct dir_bucket *b)
+{
+  struct dir_entry *entries;
+  size_t old_cnt = h->bucket_cnt;
+  size_t entry_cnt = 0;
+  size_t i, j;
+  bool success = false;
+
+  entries = malloc (h->entry_cnt * sizeof *entries);
+  if (entries == NULL && h->entry_cnt > 0)
+    return false;
+
+  /* Extend the file with empty buckets first: this is the only
+     step that can run out of disk space, and until the header is
+     rewritten the extra buckets are ignored. */
+  memset (b, 0, sizeof *b);
+  for (i = old_cnt; i < 2 * old_cnt; i++)
+    if (inode_write_at (inode, b, sizeof *b, bucket_ofs (i)) != sizeof *b)
+      goto done;
+
+  /* Collect the entries and empty the old buckets. */
+  for (i = 0; i < old_cnt; i++)
+    {
+      if (!read_bucket (inode, i, b))
+        goto done;
+      for (j = 0; j < BUCKET_ENTRIES; j++)
+        if (b->entries[j].in_use && entry_cnt < h->entry_cnt)
+          entries[entry_cnt++] = b->entries[j];
+    }
+  memset (b, 0, sizeof *b);
+  for (i = 0; i < old_cnt; i++)
+    if (inode_write_at (inode, b, sizeof *b, bucket_ofs (i)) != sizeof *b)
+      goto done;
+
+  /* Reinsert them under the new bucket count. */
+  h->bucket_cnt = 2 * old_cnt;
+  success = write_header (inode, h);
+  for (i = 0; success && i < entry_cnt; i++)
+    success = insert (inode, h, &entries[i], b);
+
+ done:
+  free (entries);
+  return success;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
+   "." names DIR itself and ".." its parent.
    On success, sets *INODE to an inode for the file, otherwise to
    a null pointer.  The caller must close *INODE. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  block_sector_t dir_sector, inode_sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  dir_sector = inode_get_inumber (dir->inode);
+  if (!strcmp (name, "."))
+    {
+      *inode = inode_reopen (dir->inode);
+      return true;
+    }
+
+  inode_lock_dir (dir->inode);
+  if (!strcmp (name, ".."))
+    {
+      struct dir_header h;
+
+      inode_sector = (read_header (dir->inode, &h)
+                      ? h.parent : DCACHE_NEGATIVE);
+    }
+  else if (!dcache_lookup (dir_sector, name, &inode_sector))
+    {
+      struct dir_header h;
+      struct dir_bucket *b = malloc (sizeof *b);
+      struct dir_entry e;
+
+      inode_sector = DCACHE_NEGATIVE;
+      if (b != NULL && read_header (dir->inode, &h))
+        {
+          if (lookup (dir, &h, name, b, &e, NULL))
+            inode_sector = e.inode_sector;
+          dcache_insert (dir_sector, name, inode_sector);
+        }
+      free (b);
+    }
+  *inode = (inode_sector != DCACHE_NEGATIVE
+            ? inode_open (inode_sector) : NULL);
+  inode_unlock_dir (dir->inode);
 
   return *inode != NULL;
 }
@@ -136,54 +417,84 @@ dir_lookup (const struct dir *dir, const char *name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long, ".", or "..") or a
+   disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_header h;
+  struct dir_bucket *b = NULL;
   struct dir_entry e;
-  off_t ofs;
+  block_sector_t cached;
   bool success = false;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  if (*name == '\0' || strlen (name) > NAME_MAX
+      || !strcmp (name, ".") || !strcmp (name, ".."))
     return false;
 
+  inode_lock_dir (dir->inode);
+
+  b = malloc (sizeof *b);
+  if (b == NULL || !read_header (dir->inode, &h))
+    goto done;
+
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  if (dcache_lookup (inode_get_inumber (dir->inode), name, &cached)
+      ? cached != DCACHE_NEGATIVE
+      : lookup (dir, &h, name, b, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  /* Make room if the directory is getting crowded. */
+  if (2 * h.entry_cnt >= h.bucket_cnt * BUCKET_ENTRIES
+      && home_bucket_full (dir->inode, &h, name, b)
+      && !grow (dir->inode, &h, b))
+    goto done;
 
   /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (!insert (dir->inode, &h, &e, b))
+    goto done;
+  h.entry_cnt++;
+  success = write_header (dir->inode, &h);
+  dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
 
  done:
+  inode_unlock_dir (dir->inode);
+  free (b);
   return success;
 }
 
+/* Returns true if directory INODE may be removed: it has no
+   entries and nobody but the caller has it open, whether as an
+   open file or as a working directory. */
+static bool
+dir_removable (struct inode *inode)
+{
+  struct dir_header h;
+  bool removable;
+
+  inode_lock_dir (inode);
+  removable = (read_header (inode, &h) && h.entry_cnt == 0
+               && inode_open_cnt (inode) == 1);
+  inode_unlock_dir (inode);
+  return removable;
+}
+
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs if
+   there is no file with the given NAME or if it is a directory
+   that is not empty or that is open. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_header h;
+  struct dir_bucket *b = NULL;
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
@@ -192,45 +503,68 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  inode_lock_dir (dir->inode);
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  b = malloc (sizeof *b);
+  if (b == NULL || !read_header (dir->inode, &h)
+      || !lookup (dir, &h, name, b, &e, &ofs))
     goto done;
 
   /* Open inode. */
   inode = inode_open (e.inode_sector);
-  if (inode == NULL)
+  if (inode == NULL || (inode_is_dir (inode) && !dir_removable (inode)))
     goto done;
 
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  dcache_insert (inode_get_inumber (dir->inode), name, DCACHE_NEGATIVE);
+  h.entry_cnt--;
+  write_header (dir->inode, &h);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  inode_unlock_dir (dir->inode);
   inode_close (inode);
+  free (b);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  Entries come back in hash order, so
+   one added or removed while reading DIR may or may not be
+   returned, and a rehash in the meantime may return some twice. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header h;
   struct dir_entry e;
+  bool success = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
-    {
-      dir->pos += sizeof e;
-      if (e.in_use)
-        {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
-    }
-  return false;
+  inode_lock_dir (dir->inode);
+  if (read_header (dir->inode, &h))
+    while ((size_t) dir->pos < h.bucket_cnt * BUCKET_ENTRIES)
+      {
+        size_t idx = dir->pos / BUCKET_ENTRIES;
+        size_t slot = dir->pos % BUCKET_ENTRIES;
+
+        if (inode_read_at (dir->inode, &e, sizeof e,
+                           bucket_ofs (idx) + slot * sizeof e) != sizeof e)
+          break;
+        dir->pos++;
+        if (e.in_use)
+          {
+            strlcpy (name, e.name, NAME_MAX + 1);
+            success = true;
+            break;
+          }
+      }
+  inode_unlock_dir (dir->inode);
+  return success;
 }
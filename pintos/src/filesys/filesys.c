@@ -2,15 +2,19 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
+static struct dir *resolve (const char *path, char name[NAME_MAX + 1]);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,7 +25,9 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
+  dcache_init ();
   free_map_init ();
 
   if (format) 
@@ -36,20 +42,22 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  cache_flush ();
 }
 
-/* Creates a file named NAME with the given INITIAL_SIZE.
+/* Creates a file named PATH with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
-   Fails if a file named NAME already exists,
+   Fails if a file named PATH already exists,
    or if internal memory allocation fails. */
 bool
-filesys_create (const char *name, off_t initial_size) 
+filesys_create (const char *path, off_t initial_size) 
 {
+  char name[NAME_MAX + 1];
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
+  struct dir *dir = resolve (path, name);
   bool success = (dir != NULL
                   && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
+                  && inode_create (inode_sector, initial_size, false)
                   && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
@@ -58,15 +66,16 @@ filesys_create (const char *name, off_t initial_size)
   return success;
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file or directory with the given PATH.
    Returns the new file if successful or a null pointer
    otherwise.
-   Fails if no file named NAME exists,
+   Fails if no file named PATH exists,
    or if an internal memory allocation fails. */
 struct file *
-filesys_open (const char *name)
+filesys_open (const char *path)
 {
-  struct dir *dir = dir_open_root ();
+  char name[NAME_MAX + 1];
+  struct dir *dir = resolve (path, name);
   struct inode *inode = NULL;
 
   if (dir != NULL)
@@ -76,19 +85,156 @@ filesys_open (const char *name)
   return file_open (inode);
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file or directory named PATH.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   Fails if no file named PATH exists, if PATH is a directory that
+   is not empty or is in use, or if an internal memory allocation
+   fails. */
 bool
-filesys_remove (const char *name) 
+filesys_remove (const char *path) 
 {
-  struct dir *dir = dir_open_root ();
+  char name[NAME_MAX + 1];
+  struct dir *dir = resolve (path, name);
   bool success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
 
   return success;
 }
+
+/* Creates a directory named PATH.
+   Returns true if successful, false otherwise.
+   Fails if a file named PATH already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *path)
+{
+  char name[NAME_MAX + 1];
+  block_sector_t inode_sector = 0;
+  struct dir *dir = resolve (path, name);
+  bool success = (dir != NULL
+                  && free_map_allocate (1, &inode_sector)
+                  && dir_create (inode_sector,
+                                 inode_get_inumber (dir_get_inode (dir)), 16)
+                  && dir_add (dir, name, inode_sector));
+  if (!success && inode_sector != 0) 
+    free_map_release (inode_sector, 1);
+  dir_close (dir);
+
+  return success;
+}
+
+/* Makes the directory named PATH the running thread's working
+   directory.  Returns true if successful, false on failure. */
+bool
+filesys_chdir (const char *path)
+{
+  char name[NAME_MAX + 1];
+  struct dir *dir = resolve (path, name);
+  struct inode *inode = NULL;
+  struct thread *t = thread_current ();
+
+  if (dir != NULL)
+    dir_lookup (dir, name, &inode);
+  dir_close (dir);
+  if (inode == NULL || !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+  dir_close (t->cwd);
+  t->cwd = dir;
+  return true;
+}
+
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX characters from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0')
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++;
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Resolves PATH, which is absolute if it starts with "/" and
+   otherwise relative to the running thread's working directory.
+   Opens and returns the directory that should contain the last
+   component of PATH and stores that component in NAME.  A PATH
+   that names the root directory yields the root and ".".
+   Returns a null pointer if PATH is empty, if a component is too
+   long, or if a component other than the last does not exist or
+   is not a directory. */
+static struct dir *
+resolve (const char *path, char name[NAME_MAX + 1])
+{
+  struct dir *dir;
+  struct dir *cwd = thread_current ()->cwd;
+  char part[NAME_MAX + 1];
+  int result;
+
+  if (*path == '\0')
+    return NULL;
+  dir = *path != '/' && cwd != NULL ? dir_reopen (cwd) : dir_open_root ();
+  if (dir == NULL)
+    return NULL;
+
+  result = get_next_part (name, &path);
+  if (result == 0)
+    strlcpy (name, ".", NAME_MAX + 1);
+
+  /* Each time another component follows, descend into the one
+     before it. */
+  while (result > 0 && (result = get_next_part (part, &path)) > 0)
+    {
+      struct inode *inode;
+
+      dir_lookup (dir, name, &inode);
+      dir_close (dir);
+      if (inode == NULL || !inode_is_dir (inode))
+        {
+          inode_close (inode);
+          return NULL;
+        }
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return NULL;
+      strlcpy (name, part, NAME_MAX + 1);
+    }
+
+  if (result < 0)
+    {
+      dir_close (dir);
+      return NULL;
+    }
+  return dir;
+}
 
 /* Formats the file system. */
 static void
@@ -96,7 +242,7 @@ do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -1,20 +1,60 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
+
+/* The free map is kept in memory and written back to its file
+   incrementally.  The file is divided into "map sectors", each
+   holding the bits for MAP_SECTOR_BITS disk sectors.
+
+   Allocating or releasing sectors only marks the map sectors that
+   changed as dirty.  free_map_flush() writes the dirty ones back;
+   it is called periodically by the buffer cache's write-behind
+   thread and when the free map is closed.
+
+   An existing free map is also read lazily, one map sector at a
+   time, so that opening it does not take time proportional to
+   the size of the disk.  Until a map sector is read, its bits are
+   all set in memory, so that the sectors it covers look in use;
+   free_map_allocate() reads more map sectors only when it cannot
+   find free space in those already read. */
+
+/* Number of free map bits in one sector of the free map file. */
+#define MAP_SECTOR_BITS (BLOCK_SECTOR_SIZE * 8)
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct bitmap *loaded_map;    /* Map sectors read from the file. */
+static struct bitmap *dirty_map;     /* Map sectors not yet written. */
+static struct lock free_map_lock;    /* Protects all of the above. */
+
+static bool load_map_sector (size_t);
+static bool load_range (block_sector_t, size_t cnt);
+static void mark_dirty (block_sector_t, size_t cnt);
 
 /* Initializes the free map. */
 void
-free_map_init (void) 
+free_map_init (void)
 {
+  size_t map_sectors;
+
+  lock_init (&free_map_lock);
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  map_sectors = DIV_ROUND_UP (bitmap_file_size (free_map), BLOCK_SECTOR_SIZE);
+  loaded_map = bitmap_create (map_sectors);
+  dirty_map = bitmap_create (map_sectors);
+  if (loaded_map == NULL || dirty_map == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+
+  /* Until free_map_open() says otherwise, the free map in memory
+     is the whole truth. */
+  bitmap_set_all (loaded_map, true);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
 }
@@ -22,19 +62,31 @@ free_map_init (void)
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available or if the free map file could not be
+   read. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  for (;;)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      size_t map_sector;
+
+      sector = bitmap_scan_and_flip_next (free_map, cnt, false);
+      if (sector != BITMAP_ERROR)
+        {
+          mark_dirty (sector, cnt);
+          break;
+        }
+
+      /* Read another part of the free map and try again. */
+      map_sector = bitmap_scan (loaded_map, 0, 1, false);
+      if (map_sector == BITMAP_ERROR || !load_map_sector (map_sector))
+        break;
     }
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
@@ -44,36 +96,73 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
+  if (!load_range (sector, cnt))
+    PANIC ("can't read free map");
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Writes the parts of the free map that have changed since they
+   were last written to the free map file.  Parts that cannot be
+   written stay dirty and are retried next time. */
+void
+free_map_flush (void)
+{
+  size_t i;
+
+  /* The write-behind thread may call us before the free map has
+     been opened. */
+  if (free_map_file == NULL)
+    return;
+
+  lock_acquire (&free_map_lock);
+  if (free_map_file != NULL)
+    for (i = bitmap_scan (dirty_map, 0, 1, true); i != BITMAP_ERROR;
+         i = bitmap_scan (dirty_map, i + 1, 1, true))
+      if (bitmap_write_part (free_map, free_map_file,
+                             i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+        bitmap_reset (dirty_map, i);
+  lock_release (&free_map_lock);
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Opens the free map file.  The free map itself is read from it
+   on demand. */
 void
-free_map_open (void) 
+free_map_open (void)
 {
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
-    PANIC ("can't read free map");
+
+  lock_acquire (&free_map_lock);
+  ASSERT (bitmap_none (dirty_map, 0, bitmap_size (dirty_map)));
+  bitmap_set_all (free_map, true);
+  bitmap_set_all (loaded_map, false);
+  lock_release (&free_map_lock);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
-free_map_close (void) 
+free_map_close (void)
 {
+  free_map_flush ();
+
+  lock_acquire (&free_map_lock);
   file_close (free_map_file);
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
 void
-free_map_create (void) 
+free_map_create (void)
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
@@ -83,3 +172,45 @@ free_map_create (void)
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
+
+/* Reads map sector MAP_SECTOR of the free map from its file.
+   Returns true if successful, false on failure.
+   free_map_lock must be held. */
+static bool
+load_map_sector (size_t map_sector)
+{
+  ASSERT (!bitmap_test (loaded_map, map_sector));
+
+  if (!bitmap_read_part (free_map, free_map_file,
+                         map_sector * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+    return false;
+  bitmap_mark (loaded_map, map_sector);
+  return true;
+}
+
+/* Makes sure that the bits for the CNT sectors starting at SECTOR
+   have been read from the free map file.  Returns true if
+   successful, false on failure.  free_map_lock must be held. */
+static bool
+load_range (block_sector_t sector, size_t cnt)
+{
+  size_t i;
+
+  for (i = sector / MAP_SECTOR_BITS; i <= (sector + cnt - 1) / MAP_SECTOR_BITS;
+       i++)
+    if (!bitmap_test (loaded_map, i) && !load_map_sector (i))
+      return false;
+  return true;
+}
+
+/* Marks the map sectors holding the bits for the CNT sectors
+   starting at SECTOR as needing to be written.  free_map_lock must
+   be held. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / MAP_SECTOR_BITS;
+  size_t last = (sector + cnt - 1) / MAP_SECTOR_BITS;
+
+  bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
@@ -1,23 +1,50 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of sector numbers held directly in an inode, and in
+   one indirect block. */
+#define DIRECT_CNT 122
+#define INDIRECT_CNT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Number of data sectors reachable through each level of the
+   index, and the largest file an inode can describe. */
+#define DIRECT_SECTORS DIRECT_CNT
+#define INDIRECT_SECTORS INDIRECT_CNT
+#define DOUBLY_INDIRECT_SECTORS (INDIRECT_CNT * INDIRECT_CNT)
+#define INODE_MAX_SECTORS \
+  (DIRECT_SECTORS + INDIRECT_SECTORS + DOUBLY_INDIRECT_SECTORS)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   Data sectors are found through a multilevel index: the first
+   DIRECT_CNT sectors directly, the next INDIRECT_CNT through one
+   indirect block, and the rest through a doubly indirect block.
+   A sector number of 0 means "not allocated"; sector 0 always
+   holds the free map's inode, so it is never a data or index
+   block.  Unallocated data sectors read as zeros. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Indirect block. */
+    block_sector_t doubly_indirect;     /* Doubly indirect block. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t is_dir;                    /* 1 if a directory, 0 if a file. */
+    uint32_t unused[1];                 /* Not used. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,49 +55,250 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   HASH_ELEM, ELEM and OPEN_CNT are protected by inode_table_lock.
+   LOCK serializes writers to the inode and protects REMOVED and
+   DENY_WRITE_CNT; readers do not take it.  DIR_LOCK is only used
+   if the inode is a directory, to make lookups and updates of its
+   entries atomic (see directory.c). */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem hash_elem;         /* Element in inode_table. */
+    struct list_elem elem;              /* Element in closed_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct lock lock;                   /* Serializes writes. */
+    struct lock dir_lock;               /* Serializes directory operations. */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Allocates a sector, fills it with zeros, and stores its number
+   in *SECTORP.  Returns true if successful, false if the disk is
+   full. */
+static bool
+allocate_zeroed (block_sector_t *sectorp)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (!free_map_allocate (1, sectorp))
+    return false;
+  cache_write (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Returns the sector number in *SLOT, a member of DATA, the
+   on-disk inode stored in INODE_SECTOR.  If the slot is empty and
+   ALLOCATE is true, first allocates a zeroed sector for it and
+   writes DATA back.  Returns 0 if the slot is empty and stays so. */
+static block_sector_t
+inode_slot (struct inode_disk *data, block_sector_t inode_sector,
+            block_sector_t *slot, bool allocate)
+{
+  if (*slot == 0 && allocate && allocate_zeroed (slot))
+    cache_write (inode_sector, data, 0, BLOCK_SECTOR_SIZE);
+  return *slot;
+}
+
+/* Returns entry IDX of index block INDEX_SECTOR, allocating a
+   zeroed sector for it first if it is empty and ALLOCATE is true.
+   Returns 0 if the entry is empty and stays so.  Index blocks are
+   read through the buffer cache, so walking them costs no disk
+   I/O once they are cached. */
+static block_sector_t
+index_slot (block_sector_t index_sector, size_t idx, bool allocate)
+{
+  block_sector_t sector;
+
+  cache_read (index_sector, &sector, idx * sizeof sector, sizeof sector);
+  if (sector == 0 && allocate && allocate_zeroed (&sector))
+    cache_write (index_sector, &sector, idx * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Returns the data sector that holds byte offset POS of the file
+   described by DATA, the on-disk inode stored in INODE_SECTOR.
+   Returns 0 if that sector is not allocated: for a hole if
+   ALLOCATE is false, or if POS is beyond the largest possible file
+   or the disk is full if ALLOCATE is true.  Offsets in the direct
+   range are resolved without any disk access. */
+static block_sector_t
+locate_sector (struct inode_disk *data, block_sector_t inode_sector,
+               off_t pos, bool allocate)
+{
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t index;
+
+  ASSERT (pos >= 0);
+
+  if (idx < DIRECT_SECTORS)
+    return inode_slot (data, inode_sector, &data->direct[idx], allocate);
+  idx -= DIRECT_SECTORS;
+
+  if (idx < INDIRECT_SECTORS)
+    {
+      index = inode_slot (data, inode_sector, &data->indirect, allocate);
+      return index != 0 ? index_slot (index, idx, allocate) : 0;
+    }
+  idx -= INDIRECT_SECTORS;
+
+  if (idx < DOUBLY_INDIRECT_SECTORS)
+    {
+      index = inode_slot (data, inode_sector, &data->doubly_indirect,
+                          allocate);
+      if (index != 0)
+        index = index_slot (index, idx / INDIRECT_CNT, allocate);
+      return index != 0 ? index_slot (index, idx % INDIRECT_CNT, allocate) : 0;
+    }
+  return 0;
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   within INODE, allocating it (and any index blocks needed to
+   reach it) if ALLOCATE is true.
+   Returns 0 if INODE has no sector allocated for offset POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos, bool allocate) 
 {
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
-    return -1;
+  return locate_sector (&inode->data, inode->sector, pos, allocate);
+}
+
+/* Returns the number of sectors, at most MAX, that hold the data
+   of INODE from byte offset POS on and lie at consecutive
+   positions on disk, starting with FIRST, the sector that holds
+   POS. */
+static size_t
+run_length (struct inode *inode, block_sector_t first, off_t pos, size_t max)
+{
+  off_t ofs = pos - pos % BLOCK_SECTOR_SIZE;
+  size_t cnt;
+
+  for (cnt = 1; cnt < max; cnt++)
+    {
+      ofs += BLOCK_SECTOR_SIZE;
+      if (ofs >= inode_length (inode)
+          || byte_to_sector (inode, ofs, false) != first + cnt)
+        break;
+    }
+  return cnt;
+}
+
+/* Releases index block SECTOR, which is LEVEL levels above the
+   data sectors it leads to, along with everything it points to. */
+static void
+release_index (block_sector_t sector, int level)
+{
+  block_sector_t *entries;
+  size_t i;
+
+  entries = malloc (BLOCK_SECTOR_SIZE);
+  if (entries == NULL)
+    PANIC ("out of memory releasing inode blocks");
+  cache_read (sector, entries, 0, BLOCK_SECTOR_SIZE);
+  for (i = 0; i < INDIRECT_CNT; i++)
+    if (entries[i] != 0)
+      {
+        if (level > 1)
+          release_index (entries[i], level - 1);
+        else
+          free_map_release (entries[i], 1);
+      }
+  free (entries);
+  free_map_release (sector, 1);
+}
+
+/* Releases every data and index block of DATA. */
+static void
+release_blocks (struct inode_disk *data)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (data->direct[i] != 0)
+      free_map_release (data->direct[i], 1);
+  if (data->indirect != 0)
+    release_index (data->indirect, 1);
+  if (data->doubly_indirect != 0)
+    release_index (data->doubly_indirect, 2);
+}
+
+/* In-memory inodes, keyed on sector, so that opening a single
+   inode twice returns the same `struct inode'.
+
+   When the last opener closes an inode that has not been removed,
+   the inode stays in the table, on the closed_inodes list, so that
+   reopening it soon does not have to read its sector again.  Only
+   the CLOSED_INODES_MAX most recently closed inodes are kept.  A
+   closed inode matches what is on disk, since every change to an
+   inode is written through to its sector. */
+static struct hash inode_table;
+
+/* Closed inodes kept in inode_table, most recently closed first. */
+static struct list closed_inodes;
+static size_t closed_inode_cnt;
+
+/* Maximum length of closed_inodes. */
+#define CLOSED_INODES_MAX 64
+
+/* Protects inode_table, closed_inodes, and each inode's open_cnt. */
+static struct lock inode_table_lock;
+
+/* Cache from which in-memory inodes are allocated. */
+static struct kmem_cache *inode_cache;
+
+/* Constructs in-memory inode INODE_ for inode_cache.  Its locks
+   are initialized only once, since every inode is freed with
+   them released. */
+static void
+inode_ctor (void *inode_)
+{
+  struct inode *inode = inode_;
+  lock_init (&inode->lock);
+  lock_init (&inode->dir_lock);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, hash_elem)->sector);
+}
+
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, hash_elem)->sector
+          < hash_entry (b, struct inode, hash_elem)->sector);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&inode_table, inode_hash, inode_less, NULL))
+    PANIC ("inode table creation failed");
+  list_init (&closed_inodes);
+  lock_init (&inode_table_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode),
+                                   inode_ctor);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is a directory if IS_DIR is true, otherwise
+   an ordinary file.  The initial LENGTH bytes are allocated (and zeroed)
+   right away, one sector at a time, so they need not be
+   contiguous; data written later past the end of file is
+   allocated only as it is written.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -85,21 +313,18 @@ inode_create (block_sector_t sector, off_t length)
   if (disk_inode != NULL)
     {
       size_t sectors = bytes_to_sectors (length);
+      size_t i;
+
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      disk_inode->is_dir = is_dir;
+      cache_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      success = sectors <= INODE_MAX_SECTORS;
+      for (i = 0; success && i < sectors; i++)
+        success = locate_sector (disk_inode, sector,
+                                 i * BLOCK_SECTOR_SIZE, true) != 0;
+      if (!success)
+        release_blocks (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -111,33 +336,45 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  lock_acquire (&inode_table_lock);
+
+  /* Check whether this inode is already in memory, either open or
+     recently closed. */
+  key.sector = sector;
+  e = hash_find (&inode_table, &key.hash_elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      inode = hash_entry (e, struct inode, hash_elem);
+      if (inode->open_cnt++ == 0)
         {
-          inode_reopen (inode);
-          return inode; 
+          list_remove (&inode->elem);
+          closed_inode_cnt--;
         }
+      lock_release (&inode_table_lock);
+      return inode;
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (inode_cache);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&inode_table_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The inode is read while inode_table_lock is
+     still held, so that nobody else can find it half-loaded. */
   inode->sector = sector;
+  hash_insert (&inode_table, &inode->hash_elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  lock_release (&inode_table_lock);
   return inode;
 }
 
@@ -146,7 +383,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&inode_table_lock);
+      inode->open_cnt++;
+      lock_release (&inode_table_lock);
+    }
   return inode;
 }
 
@@ -157,31 +398,54 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
-/* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+/* Closes INODE.
+   If this was the last reference to INODE, keeps it on the list of
+   closed inodes, freeing the least recently closed inode if the
+   list is full.  If INODE was also a removed inode, frees its
+   memory and its blocks instead. */
 void
 inode_close (struct inode *inode) 
 {
+  struct inode *victim = NULL;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
+  lock_acquire (&inode_table_lock);
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
+      ASSERT (inode->deny_write_cnt == 0);
+      if (inode->removed)
+        {
+          hash_delete (&inode_table, &inode->hash_elem);
+          victim = inode;
+        }
+      else
+        {
+          list_push_front (&closed_inodes, &inode->elem);
+          if (++closed_inode_cnt > CLOSED_INODES_MAX)
+            {
+              victim = list_entry (list_pop_back (&closed_inodes),
+                                   struct inode, elem);
+              hash_delete (&inode_table, &victim->hash_elem);
+              closed_inode_cnt--;
+            }
+        }
+    }
+  lock_release (&inode_table_lock);
+
+  /* Release resources of an inode no longer in memory. */
+  if (victim != NULL)
+    {
       /* Deallocate blocks if removed. */
-      if (inode->removed) 
+      if (victim->removed) 
         {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          free_map_release (victim->sector, 1);
+          release_blocks (&victim->data);
         }
 
-      free (inode); 
+      kmem_cache_free (inode_cache, victim);
     }
 }
 
@@ -191,23 +455,34 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inode->lock);
   inode->removed = true;
+  lock_release (&inode->lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   Readers do not lock INODE, so reads of different files, and of
+   the same file, proceed in parallel.
+   Sectors that were never written read as zeros.
+   A read that spans several sectors brings those that are
+   consecutive on disk into the buffer cache with one device
+   request.  Afterward, asks the buffer cache to read ahead as
+   many sectors following the data read as were read, in case the
+   caller is reading sequentially. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  size_t run_left = 0;
+  off_t next;
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (inode, offset, false);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,99 +495,101 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
+      if (sector_idx != 0)
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
+          /* Starting a run of sectors this read will use? */
+          if (run_left == 0 && size > chunk_size)
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              off_t end = offset + (size < inode_left ? size : inode_left);
+              size_t sector_cnt = DIV_ROUND_UP (end - offset + sector_ofs,
+                                                BLOCK_SECTOR_SIZE);
+              run_left = run_length (inode, sector_idx, offset,
+                                     (sector_cnt < CACHE_RUN_MAX
+                                      ? sector_cnt : CACHE_RUN_MAX));
+              if (run_left > 1)
+                cache_prefetch (sector_idx, run_left);
             }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          if (run_left > 0)
+            run_left--;
+          cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+        }
+      else
+        {
+          run_left = 0;
+          memset (buffer + bytes_read, 0, chunk_size);
         }
-      
+
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  next = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+  if (bytes_read > 0 && next < inode_length (inode))
+    {
+      block_sector_t ahead = byte_to_sector (inode, next, false);
+      size_t ahead_cnt = DIV_ROUND_UP (bytes_read, BLOCK_SECTOR_SIZE);
+      if (ahead_cnt > CACHE_RUN_MAX)
+        ahead_cnt = CACHE_RUN_MAX;
+      if (ahead != 0)
+        cache_read_ahead (ahead, run_length (inode, ahead, next, ahead_cnt));
+    }
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or the inode reaches its
+   maximum size.
+   A write past end of file extends the inode, allocating sectors
+   only for the bytes actually written; any gap left between the
+   old end of file and OFFSET reads as zeros.
+   Writers to the same inode are serialized, so that concurrent
+   partial writes to one sector cannot lose each other's data. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
+  lock_acquire (&inode->lock);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      lock_release (&inode->lock);
+      return 0;
+    }
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (inode, offset, true);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
-
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int chunk_size = size < sector_left ? size : sector_left;
+      if (sector_idx == 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      cache_write (sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  /* Extend the file only after its new data is in place, so that
+     a concurrent reader never sees stale sector contents. */
+  if (offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+    }
+  lock_release (&inode->lock);
 
   return bytes_written;
 }
@@ -322,8 +599,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +611,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -343,3 +624,39 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Returns true if INODE is a directory, false if it is an
+   ordinary file. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir != 0;
+}
+
+/* Returns the number of openers of INODE. */
+int
+inode_open_cnt (const struct inode *inode)
+{
+  int open_cnt;
+
+  lock_acquire (&inode_table_lock);
+  open_cnt = inode->open_cnt;
+  lock_release (&inode_table_lock);
+  return open_cnt;
+}
+
+/* Acquires INODE's directory lock, which directory.c holds while
+   it searches or modifies the entries of the directory INODE
+   represents. */
+void
+inode_lock_dir (struct inode *inode)
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock. */
+void
+inode_unlock_dir (struct inode *inode)
+{
+  lock_release (&inode->dir_lock);
+}
@@ -27,6 +27,7 @@ typedef unsigned long elem_type;
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
+    size_t next_fit;    /* Where bitmap_scan_and_flip_next() resumes. */
     elem_type *bits;    /* Elements that represent bits. */
   };
 
@@ -69,6 +70,57 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns an elem_type in which the CNT bits starting at the bit
+   numbered BIT_IDX are set, where the bits all lie in the same
+   element. */
+static inline elem_type
+range_mask (size_t bit_idx, size_t cnt)
+{
+  elem_type mask = cnt < ELEM_BITS ? ((elem_type) 1 << cnt) - 1 : (elem_type) -1;
+  ASSERT (bit_idx % ELEM_BITS + cnt <= ELEM_BITS);
+  return mask << (bit_idx % ELEM_BITS);
+}
+
+/* Returns the number of bits set in ELEM. */
+static inline size_t
+elem_popcount (elem_type elem)
+{
+  size_t cnt = 0;
+
+  /* Each iteration clears the lowest set bit. */
+  for (; elem != 0; elem &= elem - 1)
+    cnt++;
+  return cnt;
+}
+
+/* Returns the index of the first bit in B at or after START, and
+   before END, that is set to VALUE.  Returns END if there is no
+   such bit.  Examines a whole element at a time. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx = elem_idx (start);
+  size_t last_idx;
+  elem_type bits;
+
+  if (start >= end)
+    return end;
+  last_idx = elem_idx (end - 1);
+
+  /* Bits of interest are 1-bits in BITS.  Bits beyond END may be
+     garbage, so the result is clamped to END below. */
+  bits = (b->bits[idx] ^ flip) & ~(bit_mask (start) - 1);
+  while (bits == 0)
+    {
+      if (++idx > last_idx)
+        return end;
+      bits = b->bits[idx] ^ flip;
+    }
+  start = idx * ELEM_BITS + __builtin_ctzl (bits);
+  return start < end ? start : end;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -82,6 +134,7 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
+      b->next_fit = 0;
       b->bits = malloc (byte_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
@@ -104,6 +157,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
   ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
   b->bit_cnt = bit_cnt;
+  b->next_fit = 0;
   b->bits = (elem_type *) (b + 1);
   bitmap_set_all (b, false);
   return b;
@@ -214,18 +268,39 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Elements wholly inside the range are stored directly; the
+   partial elements at either end are updated atomically, as by
+   bitmap_mark() and bitmap_reset(), since they may share bits
+   with other users. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
+  size_t end = start + cnt;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end)
+    {
+      size_t idx = elem_idx (start);
+      size_t run = ELEM_BITS - start % ELEM_BITS;
+      if (run > end - start)
+        run = end - start;
+
+      if (run == ELEM_BITS)
+        b->bits[idx] = value ? (elem_type) -1 : 0;
+      else
+        {
+          elem_type mask = range_mask (start, run);
+          if (value)
+            asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+          else
+            asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+        }
+      start += run;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -233,17 +308,23 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t set_cnt = 0;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  while (start < end)
+    {
+      size_t run = ELEM_BITS - start % ELEM_BITS;
+      if (run > end - start)
+        run = end - start;
+      set_cnt += elem_popcount (b->bits[elem_idx (start)]
+                                & range_mask (start, run));
+      start += run;
+    }
+  return value ? set_cnt : cnt - set_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -251,16 +332,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_bit (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -292,20 +368,30 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Rather than testing every candidate start, skips straight to
+   the next bit set to VALUE and then past the first bit in the
+   run that is not, a whole element at a time, so each bit is
+   examined at most about twice. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt == 0)
+    return start;
+  while (cnt <= b->bit_cnt && start <= b->bit_cnt - cnt)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t stop;
+
+      start = find_bit (b, start, b->bit_cnt - cnt + 1, value);
+      if (start > b->bit_cnt - cnt)
+        break;
+      stop = find_bit (b, start, start + cnt, !value);
+      if (stop == start + cnt)
+        return start;
+      start = stop + 1;
     }
   return BITMAP_ERROR;
 }
@@ -326,6 +412,27 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
   return idx;
 }
 
+/* Like bitmap_scan_and_flip(), but uses next-fit: the search
+   begins just past the group found by the previous call, and wraps
+   around to the beginning of B if nothing is found before its end.
+   Repeated allocations thus do not rescan a long prefix of bits
+   that have already been flipped. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t cnt, bool value)
+{
+  size_t start = b->next_fit <= b->bit_cnt ? b->next_fit : 0;
+  size_t idx = bitmap_scan (b, start, cnt, value);
+
+  if (idx == BITMAP_ERROR && start > 0)
+    idx = bitmap_scan (b, 0, cnt, value);
+  if (idx != BITMAP_ERROR)
+    {
+      bitmap_set_multiple (b, idx, cnt, !value);
+      b->next_fit = idx + cnt;
+    }
+  return idx;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -359,6 +466,49 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Reads bytes OFS through OFS + SIZE of B, as laid out by
+   bitmap_write(), from the same offsets in FILE, leaving the rest
+   of B unchanged.  The range is truncated at the end of B.  OFS
+   must be a multiple of sizeof (elem_type).  Returns true if
+   successful, false otherwise. */
+bool
+bitmap_read_part (struct bitmap *b, struct file *file, size_t ofs,
+                  size_t size)
+{
+  size_t total = byte_cnt (b->bit_cnt);
+  bool success;
+
+  ASSERT (ofs % sizeof (elem_type) == 0);
+  if (ofs >= total)
+    return true;
+  if (size > total - ofs)
+    size = total - ofs;
+
+  success = (file_read_at (file, (uint8_t *) b->bits + ofs, size, ofs)
+             == (off_t) size);
+  if (ofs + size == total)
+    b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+  return success;
+}
+
+/* Writes bytes OFS through OFS + SIZE of B, as laid out by
+   bitmap_write(), to the same offsets in FILE.  The range is
+   truncated at the end of B.  Returns true if successful, false
+   otherwise. */
+bool
+bitmap_write_part (const struct bitmap *b, struct file *file, size_t ofs,
+                   size_t size)
+{
+  size_t total = byte_cnt (b->bit_cnt);
+
+  if (ofs >= total)
+    return true;
+  if (size > total - ofs)
+    size = total - ofs;
+  return (file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+          == (off_t) size);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
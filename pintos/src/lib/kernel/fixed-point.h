@@ -0,0 +1,103 @@
+#ifndef __LIB_KERNEL_FIXED_POINT_H
+#define __LIB_KERNEL_FIXED_POINT_H
+
+/* Fixed-point real arithmetic.
+
+   The kernel does not support floating point, so real numbers
+   such as the scheduler's load average are represented in 17.14
+   fixed-point format: a signed 32-bit integer whose low 14 bits
+   hold the fraction.  A value X is thus stored as X * 2**14,
+   which gives a range of roughly +/-131,071.999.
+
+   Operations on two fixed-point numbers are named fp_*();
+   operations that mix a fixed-point number with an ordinary
+   integer are named fp_*_int().  Multiplication and division
+   widen to 64 bits internally so that intermediate results do
+   not overflow. */
+
+#include <stdint.h>
+
+/* A 17.14 fixed-point number. */
+typedef int32_t fixed_t;
+
+#define FP_SHIFT 14                     /* Number of fraction bits. */
+#define FP_ONE (1 << FP_SHIFT)          /* The value 1.0. */
+
+/* Returns integer N as a fixed-point number. */
+static inline fixed_t
+fp_from_int (int n)
+{
+  return n * FP_ONE;
+}
+
+/* Returns X converted to an integer, rounding toward zero. */
+static inline int
+fp_to_int (fixed_t x)
+{
+  return x / FP_ONE;
+}
+
+/* Returns X converted to an integer, rounding to nearest. */
+static inline int
+fp_round (fixed_t x)
+{
+  return x >= 0 ? (x + FP_ONE / 2) / FP_ONE : (x - FP_ONE / 2) / FP_ONE;
+}
+
+/* Returns X + Y. */
+static inline fixed_t
+fp_add (fixed_t x, fixed_t y)
+{
+  return x + y;
+}
+
+/* Returns X - Y. */
+static inline fixed_t
+fp_sub (fixed_t x, fixed_t y)
+{
+  return x - y;
+}
+
+/* Returns X + N. */
+static inline fixed_t
+fp_add_int (fixed_t x, int n)
+{
+  return x + n * FP_ONE;
+}
+
+/* Returns X - N. */
+static inline fixed_t
+fp_sub_int (fixed_t x, int n)
+{
+  return x - n * FP_ONE;
+}
+
+/* Returns X * Y. */
+static inline fixed_t
+fp_mul (fixed_t x, fixed_t y)
+{
+  return ((int64_t) x) * y / FP_ONE;
+}
+
+/* Returns X * N. */
+static inline fixed_t
+fp_mul_int (fixed_t x, int n)
+{
+  return x * n;
+}
+
+/* Returns X / Y. */
+static inline fixed_t
+fp_div (fixed_t x, fixed_t y)
+{
+  return ((int64_t) x) * FP_ONE / y;
+}
+
+/* Returns X / N. */
+static inline fixed_t
+fp_div_int (fixed_t x, int n)
+{
+  return x / n;
+}
+
+#endif /* lib/kernel/fixed-point.h */
@@ -2,13 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,14 +24,47 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, pages are managed by a binary buddy allocator.
+   Free memory is kept as blocks of 2**ORDER pages, each aligned
+   (relative to the pool base) on a multiple of its own size, on
+   one free list per order.  An allocation takes a block from the
+   smallest nonempty list that is big enough, splitting it in
+   halves as needed, and gives back the pages past the PAGE_CNT it
+   actually needs.  A freed block is merged with its "buddy", the
+   other half of the block it was split from, for as long as that
+   buddy is also free.  Both take O(log n) time.
+
+   The pools are protected by disabling interrupts rather than by
+   a lock: the work done is short, and the scheduler frees a dying
+   thread's page with interrupts already off, where it could not
+   block on a lock. */
+
+/* Number of block orders.  Blocks of up to 2**(ORDER_CNT - 1)
+   pages, that is, 4 GB, are tracked. */
+#define ORDER_CNT 20
+
+/* Value of free_order[] for a page that does not begin a free
+   block. */
+#define NOT_FREE 0xff
+
+/* A free block.  Its first page holds this header. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in free_lists[]. */
+  };
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *free_order;                /* Order of free block at page. */
+    struct list free_lists[ORDER_CNT];  /* Free blocks, by order. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    size_t free_cnt;                    /* Number of free pages. */
+    unsigned long long fail_cnt;        /* Number of failed requests. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +73,10 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free_range (struct pool *, size_t page_idx,
+                              size_t page_cnt);
+static void print_pool_stats (struct pool *, const char *name);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -73,13 +111,21 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
   size_t page_idx;
+  enum intr_level old_level;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  old_level = intr_disable ();
+  page_idx = buddy_alloc (pool, page_cnt);
+  if (page_idx != BITMAP_ERROR)
+    {
+      ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+    }
+  else
+    pool->fail_cnt++;
+  intr_set_level (old_level);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -119,6 +165,7 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
   size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -137,8 +184,11 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  buddy_free_range (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,15 +198,27 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Prints free memory and fragmentation statistics for both
+   pools. */
+void
+palloc_print_stats (void)
+{
+  print_pool_stats (&kernel_pool, "kernel pool");
+  print_pool_stats (&user_pool, "user pool");
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map and free_order array at its
+     base.  Calculate the space needed for them and subtract it
+     from the pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int order;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -164,9 +226,16 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->free_order = (uint8_t *) base + bm_size;
+  memset (p->free_order, NOT_FREE, page_cnt);
+  for (order = 0; order < ORDER_CNT; order++)
+    list_init (&p->free_lists[order]);
   p->base = base + bm_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  p->free_cnt = 0;
+  p->fail_cnt = 0;
+  buddy_free_range (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -180,3 +249,117 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free block header in page PAGE_IDX of POOL. */
+static struct free_block *
+block_at (struct pool *pool, size_t page_idx)
+{
+  return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Adds the block of 2**ORDER pages at PAGE_IDX in POOL to the
+   free lists, first merging it with its buddy, and then with the
+   buddy of the merged block, and so on, for as long as the buddy
+   is free.  Interrupts must be off. */
+static void
+buddy_free_block (struct pool *pool, size_t page_idx, int order)
+{
+  pool->free_cnt += (size_t) 1 << order;
+  while (order < ORDER_CNT - 1)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+      if (buddy >= pool->page_cnt || pool->free_order[buddy] != order)
+        break;
+
+      list_remove (&block_at (pool, buddy)->elem);
+      pool->free_order[buddy] = NOT_FREE;
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+  pool->free_order[page_idx] = order;
+  list_push_front (&pool->free_lists[order], &block_at (pool, page_idx)->elem);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, which
+   need not form a single block: the range is split into the
+   largest aligned power-of-two blocks that cover it.
+   Interrupts must be off. */
+static void
+buddy_free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+      while (order < ORDER_CNT - 1
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+
+      buddy_free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if no free block is large
+   enough.  Interrupts must be off. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt)
+{
+  struct free_block *b;
+  size_t page_idx;
+  int want, order;
+
+  /* Find the smallest order that fits, then the smallest
+     nonempty free list of at least that order. */
+  for (want = 0; ((size_t) 1 << want) < page_cnt; want++)
+    if (want == ORDER_CNT - 1)
+      return BITMAP_ERROR;
+  for (order = want; order < ORDER_CNT; order++)
+    if (!list_empty (&pool->free_lists[order]))
+      break;
+  if (order == ORDER_CNT)
+    return BITMAP_ERROR;
+
+  b = list_entry (list_pop_front (&pool->free_lists[order]),
+                  struct free_block, elem);
+  page_idx = pg_no (b) - pg_no (pool->base);
+  pool->free_order[page_idx] = NOT_FREE;
+  pool->free_cnt -= (size_t) 1 << order;
+
+  /* Split off upper halves until the block is just big enough. */
+  while (order > want)
+    {
+      order--;
+      buddy_free_block (pool, page_idx + ((size_t) 1 << order), order);
+    }
+
+  /* Give back the pages we do not need. */
+  buddy_free_range (pool, page_idx + page_cnt,
+                    ((size_t) 1 << want) - page_cnt);
+  return page_idx;
+}
+
+/* Prints the number of free pages in POOL, named NAME, the size of
+   its largest free block, how often allocations from it failed,
+   and how many free blocks of each order it has. */
+static void
+print_pool_stats (struct pool *pool, const char *name)
+{
+  int order, largest = -1;
+
+  for (order = 0; order < ORDER_CNT; order++)
+    if (!list_empty (&pool->free_lists[order]))
+      largest = order;
+
+  printf ("Palloc: %s: %zu of %zu pages free, largest block %zu pages, "
+          "%llu failed requests\n",
+          name, pool->free_cnt, pool->page_cnt,
+          largest >= 0 ? (size_t) 1 << largest : 0, pool->fail_cnt);
+  printf ("Palloc: %s: free blocks by order:", name);
+  for (order = 0; order <= largest; order++)
+    printf (" %zu", list_size (&pool->free_lists[order]));
+  printf ("\n");
+}
@@ -0,0 +1,322 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* An object cache ("slab allocator").
+
+   malloc() rounds every request up to a power of 2, so an object
+   just over a power of 2 in size wastes nearly half its block,
+   and every request searches the descriptors for a size class.
+   A kmem_cache instead hands out objects of one exact size that
+   is fixed when the cache is created.
+
+   Each cache obtains memory one page at a time from the page
+   allocator.  Such a page, a "slab", starts with a header and is
+   otherwise divided into as many objects as fit.  The free
+   objects in a slab are chained together on a list in the slab
+   itself, so allocation and freeing take constant time.  The
+   link is stored in the first word of a free object, unless the
+   cache has a constructor, in which case it goes just past the
+   object so that the object keeps its constructed state.
+
+   A cache keeps its slabs on three lists: partial slabs, which
+   have both free and allocated objects; full slabs, which have no
+   free objects; and empty slabs, which have no allocated objects.
+   Allocations are taken from a partial slab if there is one, so
+   that allocated objects are packed into as few slabs as
+   possible.  At most one empty slab is kept to absorb an
+   alloc/free pattern that straddles a slab boundary; any others
+   are returned to the page allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Object cache. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t stride;              /* Distance between objects in a slab. */
+    size_t link_ofs;            /* Offset of free list link in object. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    kmem_ctor_func *ctor;       /* Constructor, or a null pointer. */
+    struct lock lock;           /* Protects the members below. */
+    struct list partial;        /* Slabs with some free objects. */
+    struct list full;           /* Slabs with no free objects. */
+    struct list empty;          /* Slabs with only free objects. */
+    struct list_elem elem;      /* Element in all_caches. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Number of slabs. */
+    size_t in_use;              /* Number of allocated objects. */
+    size_t peak_in_use;         /* Maximum value of in_use. */
+    unsigned long long alloc_cnt;       /* Successful allocations. */
+    unsigned long long fail_cnt;        /* Failed allocations. */
+  };
+
+/* Free list link in a free object. */
+struct free_obj
+  {
+    struct free_obj *next;      /* Next free object in slab. */
+  };
+
+/* Slab header, at the beginning of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of cache's lists. */
+    struct free_obj *free;      /* First free object. */
+    size_t free_cnt;            /* Number of free objects. */
+  };
+
+/* All caches, for kmem_print_stats(). */
+static struct list all_caches;
+static struct lock all_caches_lock;
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *obj_to_slab (void *);
+static struct free_obj *obj_link (struct kmem_cache *, void *);
+static void *link_obj (struct kmem_cache *, struct free_obj *);
+
+/* Initializes the object cache module. */
+void
+kmem_init (void)
+{
+  list_init (&all_caches);
+  lock_init (&all_caches_lock);
+}
+
+/* Creates and returns a cache of objects SIZE bytes long, named
+   NAME for statistics.  If CTOR is nonnull, it is run on each
+   object when the slab containing it is created.
+   Panics if memory is not available, since caches are created
+   during initialization. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor_func *ctor)
+{
+  struct kmem_cache *c;
+  size_t stride;
+
+  /* Objects must be aligned enough to hold a free list link, and
+     large enough unless the link follows them. */
+  size = ROUND_UP (size, sizeof (void *));
+  if (ctor != NULL)
+    stride = size + sizeof (struct free_obj);
+  else
+    stride = size > sizeof (struct free_obj) ? size : sizeof (struct free_obj);
+  ASSERT (stride <= PGSIZE - sizeof (struct slab));
+
+  c = malloc (sizeof *c);
+  if (c == NULL)
+    PANIC ("kmem_cache_create: out of memory for %s", name);
+
+  c->name = name;
+  c->obj_size = size;
+  c->stride = stride;
+  c->link_ofs = ctor != NULL ? size : 0;
+  c->objs_per_slab = (PGSIZE - sizeof (struct slab)) / stride;
+  c->ctor = ctor;
+  lock_init (&c->lock);
+  list_init (&c->partial);
+  list_init (&c->full);
+  list_init (&c->empty);
+  c->slab_cnt = 0;
+  c->in_use = 0;
+  c->peak_in_use = 0;
+  c->alloc_cnt = 0;
+  c->fail_cnt = 0;
+
+  lock_acquire (&all_caches_lock);
+  list_push_back (&all_caches, &c->elem);
+  lock_release (&all_caches_lock);
+  return c;
+}
+
+/* Obtains and returns an object from cache C.
+   Returns a null pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  struct free_obj *obj;
+  void *object;
+
+  lock_acquire (&c->lock);
+
+  /* Find a slab with a free object, preferring a partial one. */
+  if (!list_empty (&c->partial))
+    s = list_entry (list_front (&c->partial), struct slab, elem);
+  else if (!list_empty (&c->empty))
+    {
+      s = list_entry (list_pop_front (&c->empty), struct slab, elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+  else
+    {
+      s = slab_create (c);
+      if (s == NULL)
+        {
+          c->fail_cnt++;
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_front (&c->partial, &s->elem);
+    }
+
+  /* Take the object. */
+  obj = s->free;
+  s->free = obj->next;
+  object = link_obj (c, obj);
+  if (--s->free_cnt == 0)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->full, &s->elem);
+    }
+
+  c->alloc_cnt++;
+  if (++c->in_use > c->peak_in_use)
+    c->peak_in_use = c->in_use;
+  lock_release (&c->lock);
+
+  return object;
+}
+
+/* Returns OBJECT, which must have been obtained from cache C, to
+   C. */
+void
+kmem_cache_free (struct kmem_cache *c, void *object)
+{
+  struct free_obj *obj;
+  struct slab *s;
+
+  if (object == NULL)
+    return;
+
+  s = obj_to_slab (object);
+  obj = obj_link (c, object);
+  ASSERT (s->cache == c);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     that would destroy its constructed state. */
+  if (c->ctor == NULL)
+    memset (object, 0xcc, c->obj_size);
+#endif
+
+  lock_acquire (&c->lock);
+  obj->next = s->free;
+  s->free = obj;
+  c->in_use--;
+
+  if (++s->free_cnt == 1)
+    {
+      /* It was full, now it is partial. */
+      list_remove (&s->elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+  if (s->free_cnt == c->objs_per_slab)
+    {
+      /* Now it is empty.  Keep it if it is the only one. */
+      list_remove (&s->elem);
+      if (list_empty (&c->empty))
+        list_push_front (&c->empty, &s->elem);
+      else
+        {
+          s->magic = 0;
+          c->slab_cnt--;
+          palloc_free_page (s);
+        }
+    }
+  lock_release (&c->lock);
+}
+
+/* Prints statistics for each cache. */
+void
+kmem_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      printf ("Slab: %s: %zu-byte objects, %zu in use (peak %zu), "
+              "%zu slabs, %llu allocs, %llu failed\n",
+              c->name, c->obj_size, c->in_use, c->peak_in_use,
+              c->slab_cnt, c->alloc_cnt, c->fail_cnt);
+    }
+}
+
+/* Allocates a new slab for cache C, threads all of its objects
+   onto its free list, and runs C's constructor on each.
+   Returns a null pointer if memory is not available.
+   The caller must hold C's lock. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s;
+  uint8_t *objs;
+  size_t i;
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free = NULL;
+  s->free_cnt = c->objs_per_slab;
+
+  /* Thread the objects in reverse, so that they are handed out
+     in address order. */
+  objs = (uint8_t *) (s + 1);
+  for (i = c->objs_per_slab; i-- > 0; )
+    {
+      void *object = objs + i * c->stride;
+      struct free_obj *obj = obj_link (c, object);
+      if (c->ctor != NULL)
+        c->ctor (object);
+      obj->next = s->free;
+      s->free = obj;
+    }
+
+  c->slab_cnt++;
+  return s;
+}
+
+/* Returns the slab that OBJECT is inside. */
+static struct slab *
+obj_to_slab (void *object)
+{
+  struct slab *s = pg_round_down (object);
+
+  /* Check that the slab is valid and the object aligned in it. */
+  ASSERT (s != NULL);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT ((pg_ofs (object) - sizeof *s) % s->cache->stride == 0);
+
+  return s;
+}
+
+/* Returns the free list link of OBJECT in cache C. */
+static struct free_obj *
+obj_link (struct kmem_cache *c, void *object)
+{
+  return (struct free_obj *) ((uint8_t *) object + c->link_ofs);
+}
+
+/* Returns the object whose free list link is LINK in cache C. */
+static void *
+link_obj (struct kmem_cache *c, struct free_obj *link)
+{
+  return (uint8_t *) link - c->link_ofs;
+}
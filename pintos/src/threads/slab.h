@@ -0,0 +1,22 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Object cache.  Allocates objects of a single fixed size from
+   page-sized slabs.  See slab.c for details. */
+struct kmem_cache;
+
+/* Constructor, run once on each object when its slab is created.
+   Objects must be in their constructed state again when they are
+   freed. */
+typedef void kmem_ctor_func (void *object);
+
+void kmem_init (void);
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+                                      kmem_ctor_func *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -60,22 +60,19 @@ sema_init (struct semaphore *sema, unsigned value)
 void
 sema_down (struct semaphore *sema) 
 {
-	enum intr_level old_level;
-	ASSERT (sema != NULL);
-	ASSERT (!intr_context ());
-	old_level = intr_disable ();
-  	while (sema->value == 0) 
-   	{
-      		//if(!thread_mlfqs)
-            	//	donate_priority();
-	//changed the finction push back to list insert_ordered because we wanted to order all priorities
-      		//list_insert_ordered (&sema->waiters, &thread_current ()->elem,
-                  //          (list_less_func *) &compare_priority, NULL);
-      		list_push_back(&sema->waiters,&thread_current()->elem);
-		thread_block ();
-   	}
-  	sema->value--;
-  	intr_set_level (old_level);
+  enum intr_level old_level;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  while (sema->value == 0) 
+    {
+      list_push_back (&sema->waiters, &thread_current ()->elem);
+      thread_block ();
+    }
+  sema->value--;
+  intr_set_level (old_level);
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -105,7 +102,12 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.  Among waiters of equal priority, the one that
+   has waited longest is woken.
+
+   Waiters are not kept sorted because their priorities can
+   change through donation while they wait.
 
    This function may be called from an interrupt handler. */
 void
@@ -117,17 +119,17 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters))
-  {
-   //  list_sort(&sema->waiters, (list_less_func *) &compare_priority, NULL);
-
-     thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
-  }
+    {
+      struct list_elem *e = list_max (&sema->waiters, compare_priority, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
 
   sema->value++;
-  //if (!intr_context())
-    //  check_priority();
   intr_set_level (old_level);
+
+  /* The woken thread may outrank us. */
+  check_priority ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -195,6 +197,12 @@ lock_init (struct lock *lock)
    necessary.  The lock must not already be held by the current
    thread.
 
+   While we wait, our priority is donated to the lock's holder,
+   and onward along the chain of locks that holder is waiting
+   for, so that it cannot be starved by threads of intermediate
+   priority.  There is no donation under the multi-level
+   feedback queue scheduler.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -202,27 +210,24 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
-  //	enum intr_level old_level;
-	ASSERT (lock != NULL);
-  	ASSERT (!intr_context ());
-  	ASSERT (!lock_held_by_current_thread (lock));
-	//here we should disable the interrupts
-  //	old_level = intr_disable();
-
- /*	 if (lock->holder)
-  	{
-     		 thread_current()->lock_w = lock;
-      		 list_insert_ordered(&lock->holder->donation_list,
-                         &thread_current()->donation_elem,
-                         (list_less_func *) &compare_priority, NULL);
- 	 }
-  */
- 	sema_down (&lock->semaphore);
-  //	thread_current()->lock_w = NULL;
-  	lock->holder = thread_current ();
-	//enable interrupts back
-  //	intr_set_level(old_level);
-  
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  old_level = intr_disable ();
+  if (!thread_mlfqs && lock->holder != NULL)
+    {
+      cur->lock_w = lock;
+      list_push_back (&lock->holder->donation_list, &cur->donation_elem);
+      donate_priority ();
+    }
+  sema_down (&lock->semaphore);
+  cur->lock_w = NULL;
+  lock->holder = cur;
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -234,46 +239,41 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
-	bool success;
-//	enum intr_level old_level;
-  	ASSERT (lock != NULL);
-  	ASSERT (!lock_held_by_current_thread (lock));
-  	//we should disable interrupts, so that there should be no race condition
-//	old_level = intr_disable();
-
-  	success = sema_try_down (&lock->semaphore);
-  	if (success)
- 	 {
-  //    		thread_current()->lock_w = NULL;
-    		lock->holder = thread_current ();
- 	 }
-//enable interrupts back
-  //	intr_set_level(old_level);
-  	return success;
+  bool success;
+
+  ASSERT (lock != NULL);
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  success = sema_try_down (&lock->semaphore);
+  if (success)
+    lock->holder = thread_current ();
+  return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Priority donated to us by threads waiting for LOCK is given
+   back, and the highest-priority waiter is woken.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
    handler. */
-/*void release_helper(struct lock *lock)
-{
-	lock_delete(lock);	
-	new_priority();
-}*/
 void
 lock_release (struct lock *lock) 
 {
- //	enum intr_level old_level;
-	ASSERT (lock != NULL);
-  	ASSERT (lock_held_by_current_thread (lock));
-  //	old_level = intr_disable();
-	lock->holder = NULL;
-  //	if (!thread_mlfqs)
-    //  		release_helper(lock);
- 	sema_up (&lock->semaphore); 
-  //	intr_set_level (old_level);//enable interrupts back
+  enum intr_level old_level;
+
+  ASSERT (lock != NULL);
+  ASSERT (lock_held_by_current_thread (lock));
+
+  old_level = intr_disable ();
+  lock->holder = NULL;
+  if (!thread_mlfqs)
+    {
+      lock_delete (lock);
+      new_priority ();
+    }
+  sema_up (&lock->semaphore);
+  intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -292,46 +292,23 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
-/*
-void insert_helper(struct semaphore_elem *first,struct semaphore_elem *second)
-{
 
-    list_sort(&first->semaphore.waiters, (list_less_func *) &compare_priority, NULL);
-    list_sort(&second->semaphore.waiters, (list_less_func *) &compare_priority, NULL);
-}
-bool compare_sema_prio (const struct list_elem *first,
-                        const struct list_elem *second,
-                        void *aux UNUSED)
+/* Returns true if the thread waiting on semaphore_elem FIRST has
+   lower priority than the one waiting on SECOND. */
+bool
+compare_sema_prio (const struct list_elem *first,
+                   const struct list_elem *second,
+                   void *aux UNUSED)
 {
-	
-    	struct semaphore_elem *tempfirst;
-    	struct semaphore_elem *tempsecond;
-	struct thread *thrfirst;
-	struct thread *thrsecond;
-    tempfirst = list_entry(first, struct semaphore_elem, elem);
-    tempsecond = list_entry(second, struct semaphore_elem, elem);
-
-    // attain greatest semaphore
-    if (list_empty(&tempsecond->semaphore.waiters) )
-        return true;
-    if (list_empty(&tempfirst->semaphore.waiters) )
-        return false;
-
-    //list_sort(&tempfirst->semaphore.waiters, (list_less_func *) &compare_priority, NULL);
-    //list_sort(&tempsecond->semaphore.waiters, (list_less_func *) &compare_priority, NULL);
-	insert_helper(tempfirst, tempsecond);
-    thrfirst = list_entry(list_front(&tempfirst->semaphore.waiters), struct thread, elem);
-    thrsecond = list_entry(list_front(&tempsecond->semaphore.waiters), struct thread, elem);
-
-    //if (thrsecond->priority < thrfirst->priority)
-      //  return true;
-   // else return false;
-	return thrsecond->priority < thrfirst->priority;
-}*/
-
-
+  const struct semaphore_elem *a = list_entry (first, struct semaphore_elem,
+                                               elem);
+  const struct semaphore_elem *b = list_entry (second, struct semaphore_elem,
+                                               elem);
 
+  return a->thread->priority < b->thread->priority;
+}
 
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
@@ -367,24 +344,24 @@ cond_init (struct condition *cond)
 void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
-	struct semaphore_elem waiter;
+  struct semaphore_elem waiter;
 
-	ASSERT (cond != NULL);
-	ASSERT (lock != NULL);
-	ASSERT (!intr_context ());
-	ASSERT (lock_held_by_current_thread (lock));
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
   
-	sema_init (&waiter.semaphore, 0);
-	//here we should input the elements
-	//list_insert_ordered (&cond->waiters, &waiter.elem, (list_less_func *) &compare_sema_prio, NULL);
-  	list_push_back(&cond->waiters, &waiter.elem);
-	lock_release (lock);
-  	sema_down (&waiter.semaphore);
-  	lock_acquire (lock);
+  sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
+  list_push_back (&cond->waiters, &waiter.elem);
+  lock_release (lock);
+  sema_down (&waiter.semaphore);
+  lock_acquire (lock);
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one of them to wake
+   up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -399,11 +376,11 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters))
-  {
-    // list_sort(&cond->waiters, (list_less_func *) &compare_sema_prio, NULL); 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
-  }
+    {
+      struct list_elem *e = list_max (&cond->waiters, compare_sema_prio, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
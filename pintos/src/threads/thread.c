@@ -4,6 +4,7 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -16,6 +17,7 @@
 #include "userprog/process.h"
 #include "threads/malloc.h"
 #include "userprog/syscall.h"
+#include "filesys/directory.h"
 #endif
 
 /* Random value for struct thread's `magic' member.
@@ -25,9 +27,22 @@
 #define MIN_FILE_DESCRIPTOR 2
 #define NO_PARENT -1
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Maximum length of a chain of nested priority donations. */
+#define DONATION_DEPTH_MAX 8
+
+/* Number of distinct thread priorities. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+
+/* Run queue of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO list per priority level.  Bit P of
+   ready_levels is set if and only if ready_list[P - PRI_MIN] is
+   nonempty, so the highest-priority ready thread can be found
+   with a single bit scan instead of a walk over every thread. */
+#define READY_LEVEL_WORDS ((PRI_CNT + 31) / 32)
+static struct list ready_list[PRI_CNT];
+static uint32_t ready_levels[READY_LEVEL_WORDS];
+static size_t ready_cnt;        /* Total number of threads in ready_list. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -64,6 +79,23 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler state.
+
+   Every tick, only the running thread's recent_cpu changes, so
+   every fourth tick only its priority needs recomputing.  Once
+   per second the timer interrupt updates load_avg and then hands
+   the O(n) decay of every thread's recent_cpu to mlfqs_thread,
+   a kernel thread at PRI_MAX that walks all_list a batch at a
+   time with interrupts enabled in between, so a large number of
+   threads does not stretch out the timer interrupt.
+   mlfqs_cursor is that walk's position in all_list, which
+   thread_exit() advances past an exiting thread. */
+#define MLFQS_BATCH 16          /* Threads updated per interrupts-off batch. */
+static fixed_t load_avg;        /* System load average. */
+static struct thread *mlfqs_thread;
+static struct semaphore mlfqs_sema;
+static struct list_elem *mlfqs_cursor;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -75,6 +107,14 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_list_push (struct thread *);
+static struct thread *ready_list_pop (void);
+static int ready_list_max_priority (void);
+static void ready_list_remove (struct thread *);
+static void thread_update_priority (struct thread *, int priority);
+static void mlfqs_tick (struct thread *);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_daemon (void *aux UNUSED);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -92,10 +132,13 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = 0; i < PRI_CNT; i++)
+    list_init (&ready_list[i]);
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -115,6 +158,14 @@ thread_start (void)
   sema_init (&idle_started, 0);
   thread_create ("idle", PRI_MIN, idle, &idle_started);
 
+  /* Create the thread that does the once-per-second MLFQS
+     bookkeeping. */
+  if (thread_mlfqs)
+    {
+      sema_init (&mlfqs_sema, 0);
+      thread_create ("mlfqs", PRI_MAX, mlfqs_daemon, NULL);
+    }
+
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
@@ -139,6 +190,9 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
@@ -164,9 +218,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, the running thread yields to it immediately. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -211,23 +264,21 @@ thread_create (const char *name, int priority,
 
   intr_set_level (old_level);
 
+#ifdef USERPROG
   // add child process to list of children
   t->parent = thread_tid();
   struct child_process *cp = newchild(t->tid);
   t->cp = cp;
-/*struct child_process* cp = malloc(sizeof(struct child_process));
-cp->pid = t->tid;
-cp->load=NOT_LOADED;
-cp->wait= false;
-cp->exit = false;
-lock_init(&cp->wait_lock);
-list_push_back(&thread_current()->child_list, &cp->elem);*/
-  /* Add to run queue. */
+
+  // the child starts out in its parent's working directory
+  if (thread_current()->cwd != NULL)
+      t->cwd = dir_reopen(thread_current()->cwd);
+#endif
+
+  /* Add to run queue, and let it run right away if it outranks
+     us. */
   thread_unblock (t);
-  //compared after comparing to "that file"
-	//old_level = intr_disable();
-  //check_priority();
-  //intr_set_level (old_level);
+  check_priority ();
 
   return tid;
 }
@@ -255,7 +306,9 @@ thread_block (void)
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  Callers that want a higher-priority
+   thread to run immediately should call check_priority()
+   afterward. */
 void
 thread_unblock (struct thread *t) 
 {
@@ -265,10 +318,8 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  //list_insert_ordered (&ready_list, &t->elem,
-//			(list_less_func *) &compare_priority, NULL);
-	list_push_back(&ready_list, &t->elem);
-	t->status = THREAD_READY;
+  ready_list_push (t);
+  t->status = THREAD_READY;
   intr_set_level (old_level);
 }
 
@@ -320,6 +371,8 @@ thread_exit (void)
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  if (mlfqs_cursor == &thread_current ()->allelem)
+    mlfqs_cursor = list_next (mlfqs_cursor);
   list_remove (&thread_current()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -339,13 +392,34 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-	list_push_back(&ready_list, &cur->elem);
-    //list_insert_ordered (&ready_list, &cur->elem, (list_less_func *) &compare_priority, NULL);
-	cur->status = THREAD_READY;
+    ready_list_push (cur);
+  cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if some ready thread has a higher priority than
+   the running thread.  Within an interrupt handler, arranges for
+   the yield to happen on return from the interrupt instead.
+
+   May be called with interrupts on or off. */
+void
+check_priority (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
+  int cur_priority = cur != idle_thread ? cur->priority : PRI_MIN - 1;
+  bool preempt = ready_list_max_priority () > cur_priority;
+  intr_set_level (old_level);
+
+  if (!preempt)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else
+    thread_yield ();
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -363,82 +437,177 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY.  While
+   other threads are donating a higher priority to us, the new
+   priority only takes effect once they stop.  Ignored under the
+   multi-level feedback queue scheduler, which sets priorities
+   itself. */
 void
 thread_set_priority (int new_prio) 
 {
-	/*//declaring the neccessary elements for disabling the timer
-	//and getting new priority of the thread
-	enum intr_level old_level;
-	int prev_prio;
-    	old_level= intr_disable();
-	prev_prio = thread_current()->priority;
-	thread_current()->init_prio = new_prio;
-	new_priority();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_prio && new_prio <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  thread_current ()->init_prio = new_prio;
+  new_priority ();
+  intr_set_level (old_level);
 
-	// donating if new prio is higher
-    	(prev_prio < thread_current()->priority) ? donate_priority() : check_priority();
-   	 // enabling interrupts
-    	intr_set_level (old_level);
-*/
-	thread_current()->priority = new_prio;
+  check_priority ();
 }
 
 /* Returns the current thread's priority. */
 int
 thread_get_priority (void) 
 {
-/*	//we should disable the interrupts
-    	enum intr_level old_level;
-    	int temp_prio; //holds the current thread's priority
-    	old_level = intr_disable();
-    	temp_prio = thread_current()->priority;
-   	intr_set_level (old_level); // enable back the interrupts
-    	return temp_prio; //return the priority*/
-	return thread_current()->priority;
+  return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-    /*enum intr_level old_level = intr_disable();
-    thread_current()->nice = nice;
-    check_priority();
-    intr_set_level(old_level);
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
-*/
-}
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    cur->priority = mlfqs_priority (cur);
+  intr_set_level (old_level);
 
+  check_priority ();
+}
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /*  enum intr_level old_level = intr_disable();
-    int temp = thread_current()->nice;
-    intr_set_level(old_level);
-  return temp;
-*/
-	return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-    
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_round (fp_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fp_round (fp_mul_int (thread_current ()->recent_cpu,
+                                             100));
+  intr_set_level (old_level);
+
+  return recent_cpu_100;
 }
-
+
+/* Returns the priority the multi-level feedback queue scheduler
+   assigns T, based on its recent_cpu and nice values. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = PRI_MAX - fp_to_int (fp_div_int (t->recent_cpu, 4))
+                 - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  if (priority > PRI_MAX)
+    return PRI_MAX;
+  return priority;
+}
+
+/* Multi-level feedback queue scheduler work done on each timer
+   tick, in external interrupt context, on behalf of the running
+   thread CUR. */
+static void
+mlfqs_tick (struct thread *cur)
+{
+  int64_t ticks = timer_ticks ();
+
+  if (cur != idle_thread)
+    cur->recent_cpu = fp_add_int (cur->recent_cpu, 1);
+
+  if (ticks % TIMER_FREQ == 0)
+    {
+      /* The running thread counts as ready, the idle thread does
+         not. */
+      int ready_threads = ready_cnt + (cur != idle_thread ? 1 : 0);
+
+      load_avg = fp_add (fp_div_int (fp_mul_int (load_avg, 59), 60),
+                         fp_div_int (fp_from_int (ready_threads), 60));
+      sema_up (&mlfqs_sema);
+    }
+  else if (ticks % TIME_SLICE == 0 && cur != idle_thread
+           && cur != mlfqs_thread)
+    {
+      /* Nobody else's recent_cpu or nice has changed since the
+         last recomputation. */
+      cur->priority = mlfqs_priority (cur);
+      check_priority ();
+    }
+}
+
+/* Thread function for mlfqs_thread.  Once per second, decays
+   every thread's recent_cpu and recomputes its priority. */
+static void
+mlfqs_daemon (void *aux UNUSED)
+{
+  enum intr_level old_level = intr_disable ();
+  mlfqs_thread = thread_current ();
+  mlfqs_thread->priority = PRI_MAX;
+  intr_set_level (old_level);
+
+  for (;;)
+    {
+      fixed_t twice_load, coefficient;
+      int batch = 0;
+
+      sema_down (&mlfqs_sema);
+
+      old_level = intr_disable ();
+      twice_load = fp_mul_int (load_avg, 2);
+      coefficient = fp_div (twice_load, fp_add_int (twice_load, 1));
+      mlfqs_cursor = list_begin (&all_list);
+      while (mlfqs_cursor != list_end (&all_list))
+        {
+          struct thread *t = list_entry (mlfqs_cursor, struct thread,
+                                         allelem);
+          mlfqs_cursor = list_next (mlfqs_cursor);
+          if (t == idle_thread || t == mlfqs_thread)
+            continue;
+
+          t->recent_cpu = fp_add_int (fp_mul (coefficient, t->recent_cpu),
+                                      t->nice);
+          thread_update_priority (t, mlfqs_priority (t));
+
+          /* Give pending interrupts a chance now and then. */
+          if (++batch % MLFQS_BATCH == 0)
+            {
+              intr_set_level (old_level);
+              old_level = intr_disable ();
+            }
+        }
+      mlfqs_cursor = NULL;
+      intr_set_level (old_level);
+    }
+}
+
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
@@ -514,6 +683,9 @@ is_thread (struct thread *t)
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
+  struct thread *parent = running_thread ();
+  enum intr_level old_level;
+
   ASSERT (t != NULL);
   ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
   ASSERT (name != NULL);
@@ -524,22 +696,41 @@ init_thread (struct thread *t, const char *name, int priority)
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
   t->magic = THREAD_MAGIC;
+
+  /* A new thread inherits its parent's nice and recent_cpu. */
+  if (parent != t)
+    {
+      t->nice = parent->nice;
+      t->recent_cpu = parent->recent_cpu;
+    }
+  if (thread_mlfqs)
+    t->priority = mlfqs_priority (t);
+
+  old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
+  intr_set_level (old_level);
 
   // proj 2 added: used for file system sys calls
-  list_init(&t->files);
-  t->fd = MIN_FILE_DESCRIPTOR;
+  t->fd_table = NULL;
+  t->fd_cap = 0;
+  t->fd_low = MIN_FILE_DESCRIPTOR;
+#ifdef VM
+  t->exec_file = NULL;
+  t->user_esp = NULL;
+#endif
 
   list_init(&t->child_list);
   t->cp = NULL;
   t->parent = NO_PARENT;
+  t->cwd = NULL;
+#ifdef VM
+  list_init(&t->mapping_list);
+  t->next_mapid = 0;
+#endif
 
-  // added for priority part
-  //t->lock_w = NULL;
-  //t->init_prio = priority;
-  //list_init(&t->donation_list);
-
-
+  t->init_prio = t->priority;
+  t->lock_w = NULL;
+  list_init (&t->donation_list);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -563,10 +754,96 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  struct thread *t = ready_list_pop ();
+  return t != NULL ? t : idle_thread;
+}
+
+/* Appends T to the tail of the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_list_push (struct thread *t)
+{
+  int level = t->priority - PRI_MIN;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&ready_list[level], &t->elem);
+  ready_levels[level / 32] |= 1u << (level % 32);
+  ready_cnt++;
+}
+
+/* Removes T, which must be in the ready state, from the run
+   queue.  Interrupts must be off. */
+static void
+ready_list_remove (struct thread *t)
+{
+  int level = t->priority - PRI_MIN;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_list[level]))
+    ready_levels[level / 32] &= ~(1u << (level % 32));
+  ready_cnt--;
+}
+
+/* Changes T's priority to PRIORITY, moving T to the matching run
+   queue if it is ready.  Does not preempt the running thread.
+   Interrupts must be off. */
+static void
+thread_update_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY && t != idle_thread)
+    {
+      ready_list_remove (t);
+      t->priority = priority;
+      ready_list_push (t);
+    }
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    t->priority = priority;
+}
+
+/* Returns the priority of the highest-priority ready thread, or
+   PRI_MIN - 1 if the run queue is empty.  Interrupts must be
+   off. */
+static int
+ready_list_max_priority (void)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = READY_LEVEL_WORDS - 1; i >= 0; i--)
+    if (ready_levels[i] != 0)
+      return PRI_MIN + i * 32 + (31 - __builtin_clz (ready_levels[i]));
+  return PRI_MIN - 1;
+}
+
+/* Removes and returns the thread at the head of the
+   highest-priority nonempty run queue, or a null pointer if no
+   thread is ready.  Interrupts must be off. */
+static struct thread *
+ready_list_pop (void)
+{
+  int priority = ready_list_max_priority ();
+  int level = priority - PRI_MIN;
+  struct list_elem *e;
+  struct thread *t;
+
+  if (priority < PRI_MIN)
+    return NULL;
+
+  e = list_front (&ready_list[level]);
+  t = list_entry (e, struct thread, elem);
+  ready_list_remove (t);
+  return t;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -652,6 +929,8 @@ allocate_tid (void)
   return tid;
 }
 
+/* Offset of `stack' member within `struct thread'.
+   Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
 bool thread_alive (int pid)
@@ -666,123 +945,82 @@ bool thread_alive (int pid)
     }
     return false;
 }
-/*
-bool compare_priority (const struct list_elem *first,
-		       const struct list_elem *second,
-		       void *aux UNUSED)
-{
 
-	struct thread *tempfirst;
-	struct thread *tempsecond;
-	tempfirst = list_entry(first, struct thread, elem);
-	tempsecond = list_entry(second, struct thread, elem);
-	return tempfirst->priority > tempsecond->priority;
-	
-}
-// added functions
-bool compare_wakeup_time (const struct list_elem *first,
-			  const struct list_elem *second,
-			  void *aux UNUSED)
+/* Returns true if the thread owning list element FIRST has lower
+   priority than the one owning SECOND.  Both elements must be
+   `elem' members of struct thread. */
+bool
+compare_priority (const struct list_elem *first,
+                  const struct list_elem *second,
+                  void *aux UNUSED)
 {
-	
-	struct thread *tempfirst;
-	struct thread *tempsecond;
-	tempfirst = list_entry(first, struct thread, elem);
-	tempsecond = list_entry(second, struct thread, elem);
-	return tempfirst->awake_time < tempsecond->awake_time;
-	
-}
+  const struct thread *a = list_entry (first, struct thread, elem);
+  const struct thread *b = list_entry (second, struct thread, elem);
 
+  return a->priority < b->priority;
+}
 
-void check_priority (void)
+/* Donates the current thread's priority to the holder of the
+   lock it is waiting for, then to the holder of the lock that
+   thread is waiting for, and so on, up to DONATION_DEPTH_MAX
+   levels deep.  Interrupts must be off. */
+void
+donate_priority (void)
 {
-	struct thread *thr;
-	if (list_empty(&ready_list) )
-        	return;
-
-	thr = list_entry(list_front(&ready_list),
-                                struct thread, elem);
-
-    	if (intr_context())
-   	{
-       		 ++thread_ticks;
-        	if (thread_current()->priority < thr->priority ||
-            		(thread_ticks >= TIME_SLICE &&
-            		thread_current()->priority == thr->priority))
-            			intr_yield_on_return();
+  struct thread *t = thread_current ();
+  int depth;
 
-       		return;
-    }
+  ASSERT (intr_get_level () == INTR_OFF);
 
-   	if (thread_current()->priority < thr->priority)
-     		 thread_yield();
-} 
-void new_priority_helper(struct thread *curr, struct thread *thr)
-{
-	curr = list_entry(list_front(&thr->donation_list),
-				struct thread, donation_elem);
-		
-        if (thr->priority < curr->priority)
-            		thr->priority = curr->priority;
-	
-}
-void new_priority(void)
-{
-	struct thread *s;
-    	struct thread *thr = thread_current();
-    	thr->priority = thr->init_prio;
-    	if (!list_empty(&thr->donation_list))
-    	{
-        	//s = list_entry(list_front(&thr->donation_list),
-                  //                      struct thread, donation_elem);
-
-        //	if (thr->priority < s->priority)
-          //  		thr->priority = s->priority;
-          	new_priority_helper(s,thr);
-    	}
-    	else
-     		 return;
-}
-
-void donate_priority(void)
-{
-    	struct thread *thr = thread_current();
-    	int d = 0;
-   	struct lock *lock;
-	lock = thr->lock_w;
-    	while (d < 8 && lock)
-   	 {
-       		 ++d;
-
-        	// if lock is free, return
-        	if (!lock->holder || lock->holder->priority >= thr->priority)
-            		return;
-
-        	lock->holder->priority = thr->priority;
-       		thr = lock->holder;
-        	lock = thr->lock_w;
+  for (depth = 0; depth < DONATION_DEPTH_MAX && t->lock_w != NULL; depth++)
+    {
+      struct thread *holder = t->lock_w->holder;
+      if (holder == NULL || holder->priority >= t->priority)
+        break;
+      thread_update_priority (holder, t->priority);
+      t = holder;
     }
 }
 
-
-void lock_delete(struct lock *lock)
+/* Resets the current thread's priority to the higher of its own
+   priority and the highest priority donated to it by threads
+   still waiting on locks it holds.  Interrupts must be off. */
+void
+new_priority (void)
 {
-    struct list_elem *e = list_begin(&thread_current()->donation_list);
-    struct list_elem *next_elem;
-    while (e != list_end(&thread_current()->donation_list))
-    {
-        struct thread *thr = list_entry(e, struct thread, donation_elem);
-        next_elem = list_next(e);
-        if (thr->lock_w == lock)
-            list_remove(e);
+  struct thread *cur = thread_current ();
+  int priority = cur->init_prio;
+  struct list_elem *e;
 
-        e = next_elem;
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&cur->donation_list);
+       e != list_end (&cur->donation_list); e = list_next (e))
+    {
+      struct thread *donor = list_entry (e, struct thread, donation_elem);
+      if (donor->priority > priority)
+        priority = donor->priority;
     }
+  cur->priority = priority;
 }
 
+/* Removes from the current thread's donation list every thread
+   waiting for LOCK, which the current thread is releasing.
+   Interrupts must be off. */
+void
+lock_delete (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e = list_begin (&cur->donation_list);
 
+  ASSERT (intr_get_level () == INTR_OFF);
 
-
-*/
-/* Offset of `stack' member within `struct thread'.
-   Used by switch.S, which can't figure it out on its own. */
+  while (e != list_end (&cur->donation_list))
+    {
+      struct thread *donor = list_entry (e, struct thread, donation_elem);
+      if (donor->lock_w == lock)
+        e = list_remove (e);
+      else
+        e = list_next (e);
+    }
+}
@@ -5,6 +5,10 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include <fixed-point.h>
+#ifdef VM
+#include <hash.h>
+#endif
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -25,6 +29,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread nice values. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default nice value. */
+#define NICE_MAX 20                     /* Least nice to other threads. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -91,18 +100,21 @@ struct thread
     int priority;                       /* Priority. */
     struct list_elem allelem;           /* List element for all threads list. */
 
-    // added for alarm part
-  //  int64_t awake_time; // when to wake up
-   // struct semaphore sema_s; // enables thread to be put to sleep and to be woken
-    //struct list_elem s_elem; // specifies element of s_thread_list
-    
-    // added for priority part
-    //int init_prio; // initial priority of thread (non-donated)
-    //struct lock *lock_w; // the lock the thread is currently waiting for
-    //struct list donation_list; // a list of threads waiting on the lock current thread is holding
-    //struct list_elem donation_elem; // can be added to another thread's d_list
-    
-  //  int nice; 
+    /* Owned by devices/timer.c. */
+    int64_t awake_time;                 /* Tick to wake up at in timer_sleep(). */
+
+    /* Shared between thread.c and synch.c, for priority
+       donation.  `priority' above is the effective priority. */
+    int init_prio;                      /* Priority before donations. */
+    struct lock *lock_w;                /* Lock being waited for, if any. */
+    struct list donation_list;          /* Threads donating priority to us. */
+    struct list_elem donation_elem;     /* Element in a donation_list. */
+
+    /* Owned by thread.c, for the multi-level feedback queue
+       scheduler. */
+    int nice;                           /* Niceness, NICE_MIN to NICE_MAX. */
+    fixed_t recent_cpu;                 /* Recently used CPU time. */
+
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
     	
@@ -110,13 +122,21 @@ struct thread
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
 #endif
+#ifdef VM
+    /* Owned by vm/page.c and userprog/process.c. */
+    struct hash pages;                  /* Supplemental page table. */
+    struct file *exec_file;             /* Executable, for demand paging. */
+    void *user_esp;                     /* User esp on entry to kernel. */
+#endif
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
 
-    // added for syscall part
-    struct list files;
-    int fd;
+    // added for syscall part: fd_table[fd] is the file open as
+    // fd, or NULL; it is grown on demand by userprog/syscall.c
+    struct file **fd_table;
+    int fd_cap;                         // number of slots in fd_table
+    int fd_low;                         // every fd below this is in use
     // needed for wait/exec syscalls
     struct list child_list;
     tid_t parent;
@@ -124,6 +144,15 @@ struct thread
     // points to child_process struct in parent's child list
     struct child_process *cp;
 
+    // working directory for relative paths; NULL means the root
+    struct dir *cwd;
+
+#ifdef VM
+    // memory mappings made by mmap, and the id for the next one
+    struct list mapping_list;
+    int next_mapid;
+#endif
+
   };
 /*struct wait_status
 {
@@ -157,6 +186,7 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void check_priority (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -174,19 +204,11 @@ int thread_get_load_avg (void);
 
 bool thread_alive (int pid);
 
-// added functions
-//bool compare_wakeup_time (const struct list_elem *first,
-//			  const struct list_elem *second,
-//			  void *aux UNUSED);
-
-//bool compare_priority (const struct list_elem *first,
-//		       const struct list_elem *second,
-//		       void *aux UNUSED);
-		       
-//void lock_delete (struct lock *lock);
-//void new_priority (void);
-//void check_priority (void);
-//void donate_priority (void);
-
+bool compare_priority (const struct list_elem *first,
+                       const struct list_elem *second,
+                       void *aux);
+void donate_priority (void);
+void new_priority (void);
+void lock_delete (struct lock *lock);
 
 #endif /* threads/thread.h */
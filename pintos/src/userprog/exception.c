@@ -5,6 +5,10 @@
 #include <user/syscall.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -148,6 +152,25 @@ page_fault (struct intr_frame *f)
   not_present = (f->error_code & PF_P) == 0;
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
+
+#ifdef VM
+  /* A fault on a page that is not present may just mean that the
+     page has been reserved but not yet loaded, or that the stack
+     needs to grow, and a write to a read-only page may be the
+     first write to a zero page.  If so, load the page and let the
+     access retry.  A fault in the kernel happens during a system
+     call, so the stack pointer to judge by is the one the process
+     had on entry. */
+  if (is_user_vaddr (fault_addr) && (not_present || write))
+    {
+      void *esp = user ? f->esp : thread_current ()->user_esp;
+
+      if (page_load (fault_addr, write)
+          || (not_present && page_grow_stack (fault_addr, esp)
+              && page_load (fault_addr, write)))
+        return;
+    }
+#endif
 if(user == NULL)
 {
 exit(-1);
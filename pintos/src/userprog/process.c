@@ -19,6 +19,9 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp, 
@@ -70,13 +73,12 @@ start_process (void *file_name_)
   if_.eflags = FLAG_IF | FLAG_MBS;
   success = load (file_name, &if_.eip, &if_.esp, &save_ptr);
 
-  if (success)
+  // let exec() in the parent know how loading went
+  struct child_process *cp = thread_current()->cp;
+  if (cp)
   {
-      thread_current()->cp->load = LOAD_SUCCESS;
-  }
-  else {
-      thread_current()->cp->load = LOAD_FAIL;
-
+      cp->load = success ? LOAD_SUCCESS : LOAD_FAIL;
+      sema_up(&cp->load_sema);
   }
 
   /* If load failed, quit. */
@@ -101,20 +103,19 @@ start_process (void *file_name_)
    been successfully called for the given TID, returns -1
    immediately, without waiting.
 
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   The caller sleeps on the child's exit semaphore rather than
+   spinning, so the child gets the CPU time it needs to finish. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
 {
     struct child_process *cp = getchild(child_tid);
     if (!cp)
         return ERROR;
     if (cp->wait)
         return ERROR;
-   cp->wait = true;
-    while (!cp->exit)
-        barrier();
-    
+    cp->wait = true;
+    sema_down(&cp->exit_sema);
+
     int status = cp->status;
     byechild(cp);
     return status;
@@ -131,11 +132,25 @@ process_exit (void)
 
   // added to close the files that have been opened by the process
   byefile(CLOSE_ALL);
+#ifdef VM
+  // write back and remove the memory mappings while the page
+  // directory still exists
+  byemapping(CLOSE_ALL);
+#endif
+  dir_close(cur->cwd);
+  cur->cwd = NULL;
   
   byechildren();
 
-  if (thread_alive(cur->parent))
+  // wake a waiting parent and drop our reference to the shared
+  // record; the parent may already have exited, that's fine
+  if (cur->cp)
+  {
       cur->cp->exit = true;
+      sema_up(&cur->cp->exit_sema);
+      releasechild(cur->cp);
+      cur->cp = NULL;
+  }
 
 
  // Destroy the current process's page directory and switch back
@@ -143,6 +158,12 @@ process_exit (void)
   pd = cur->pagedir;
   if (pd != NULL) 
     {
+#ifdef VM
+      page_table_destroy (&cur->pages);
+      file_close (cur->exec_file);
+      cur->exec_file = NULL;
+#endif
+
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
@@ -263,6 +284,14 @@ load (const char *file_name, void (**eip) (void), void **esp, char **save_ptr)
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
+#ifdef VM
+  if (!page_table_init (&t->pages))
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      goto done;
+    }
+#endif
   process_activate ();
 
   /* Open executable file. */
@@ -356,13 +385,25 @@ load (const char *file_name, void (**eip) (void), void **esp, char **save_ptr)
 
  done:
   /* We arrive here whether the load is successful or not. */
+#ifdef VM
+  /* Pages are read from the executable on demand, so keep it open,
+     and unmodified, for as long as the process runs. */
+  if (success)
+    {
+      file_deny_write (file);
+      t->exec_file = file;
+      return success;
+    }
+#endif
   file_close (file);
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -421,6 +462,9 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only reserved in the supplemental page
+   table here, and read in by page_fault() on first access.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -431,6 +475,24 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  while (read_bytes > 0 || zero_bytes > 0) 
+    {
+      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+      bool ok = (page_read_bytes > 0
+                 ? page_add_file (upage, file, ofs, page_read_bytes, writable)
+                 : page_add_zero (upage, writable));
+      if (!ok)
+        return false;
+
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+  return true;
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -466,6 +528,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       upage += PGSIZE;
     }
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -473,21 +536,25 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp, const char* file_name, char** save_ptr) 
 {
-  uint8_t *kpage;
   bool success = false;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+#ifdef VM
+  /* The stack page is an ordinary zero page, loaded right away
+     since the arguments are pushed onto it. */
+  void *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  success = page_add_zero (upage, true) && page_load (upage, true);
+#else
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL) 
     {
       success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
-      else
-      {
+      if (!success)
         palloc_free_page (kpage);
-        return success;
-      }
     }
+#endif
+  if (!success)
+    return success;
+  *esp = PHYS_BASE;
    
   char *token;
   char **argv = malloc(DEFAULT_ARGV*sizeof(char *));
@@ -540,6 +607,7 @@ setup_stack (void **esp, const char* file_name, char** save_ptr)
 
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -559,3 +627,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
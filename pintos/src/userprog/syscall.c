@@ -1,7 +1,10 @@
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 
 #include "userprog/syscall.h"
@@ -9,6 +12,7 @@
 #include "devices/input.h"
 #include "devices/shutdown.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 
 #include "threads/interrupt.h"
@@ -16,149 +20,365 @@
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 #define MAX_ARGS 3
 #define USER_VADDR_BOTTOM ((void *) 0x08048000)
 
 // new vars/structs
-struct lock filesys_lock;
-
-struct process_file {
-    struct file *file;
-    int fd;
-    struct list_elem elem;
+// there is no global file system lock: the filesys layer locks
+// inodes, open files, directories and the free map individually,
+// so independent files can be used concurrently
+
+// initial number of slots in a process's fd table; the table
+// doubles whenever it fills up
+#define FD_TABLE_INIT 16
+
+// object cache for the per-child bookkeeping, which is allocated
+// and freed on every exec/exit
+static struct kmem_cache *child_process_cache;
+
+#ifdef VM
+// a file mapped into memory by mmap; its pages are loaded on demand
+// and written back to the file when evicted or unmapped
+struct mapping {
+    mapid_t id;
+    struct file *file;              // own reopened copy, so closing
+                                    // the fd leaves the mapping alone
+    uint8_t *addr;                  // first mapped page
+    int page_cnt;                   // number of mapped pages
+    struct list_elem elem;          // in the thread's mapping_list
 };
+#endif
 
 // fd = file descriptor
 // fd = integer
 //new fns
-int UK_pointer (const void *vaddr); // user to kernel
 int newfile (struct file *file);
 void byefile (int fd);
 struct file* getfile(int fd);
 static void syscall_handler (struct intr_frame *);
 void get_arg (struct intr_frame *f, int *arg, int n);
 void check_valid_ptr (const void *vaddr);
-void check_valid_buffer (void* buffer, unsigned size);
+void check_valid_buffer (const void *buffer, unsigned size, bool writable);
+void check_valid_string (const char *str);
+#ifdef VM
+void unpin_buffer (const void *buffer, unsigned size);
+#endif
 
 void
 syscall_init (void) 
 {
-    lock_init(&filesys_lock);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  child_process_cache = kmem_cache_create ("child_process",
+                                           sizeof (struct child_process), NULL);
 }
 
-static void
-syscall_handler (struct intr_frame *f UNUSED) 
+// how the syscall handler validates one argument word before the
+// syscall sees it
+enum arg_kind {
+    ARG_INT,                        // plain value, nothing to check
+    ARG_STRING,                     // user string
+    ARG_BUFFER_IN,                  // user buffer the kernel reads; its
+                                    // size is the following argument
+    ARG_BUFFER_OUT,                 // user buffer the kernel writes; its
+                                    // size is the following argument
+    ARG_NAME_OUT                    // user buffer the kernel writes a
+                                    // file name to, READDIR_MAX_LEN + 1
+                                    // bytes long
+};
+
+// a syscall, called with its validated argument words; the return
+// value goes in eax (and is ignored by void syscalls)
+typedef int syscall_func (int *arg);
+
+// one entry of the dispatch table, with latency statistics
+struct syscall_desc {
+    const char *name;
+    syscall_func *func;
+    int argc;                       // number of argument words
+    enum arg_kind kinds[MAX_ARGS];  // how to validate each of them
+
+    unsigned long long cnt;         // number of calls
+    uint64_t cycles;                // TSC cycles spent, total
+    uint64_t max_cycles;            // TSC cycles of the slowest call
+};
+
+static int sys_halt (int *arg);
+static int sys_exit (int *arg);
+static int sys_exec (int *arg);
+static int sys_wait (int *arg);
+static int sys_create (int *arg);
+static int sys_remove (int *arg);
+static int sys_open (int *arg);
+static int sys_filesize (int *arg);
+static int sys_read (int *arg);
+static int sys_write (int *arg);
+static int sys_seek (int *arg);
+static int sys_tell (int *arg);
+static int sys_close (int *arg);
+static int sys_chdir (int *arg);
+static int sys_mkdir (int *arg);
+static int sys_readdir (int *arg);
+static int sys_isdir (int *arg);
+static int sys_inumber (int *arg);
+#ifdef VM
+static int sys_mmap (int *arg);
+static int sys_munmap (int *arg);
+#endif
+
+// dispatch table, indexed by syscall number; numbers with no entry
+// are not implemented and kill the caller
+static struct syscall_desc syscalls[] = {
+    [SYS_HALT]     = {"halt", sys_halt, 0, {}},
+    [SYS_EXIT]     = {"exit", sys_exit, 1, {ARG_INT}},
+    [SYS_EXEC]     = {"exec", sys_exec, 1, {ARG_STRING}},
+    [SYS_WAIT]     = {"wait", sys_wait, 1, {ARG_INT}},
+    [SYS_CREATE]   = {"create", sys_create, 2, {ARG_STRING, ARG_INT}},
+    [SYS_REMOVE]   = {"remove", sys_remove, 1, {ARG_STRING}},
+    [SYS_OPEN]     = {"open", sys_open, 1, {ARG_STRING}},
+    [SYS_FILESIZE] = {"filesize", sys_filesize, 1, {ARG_INT}},
+    [SYS_READ]     = {"read", sys_read, 3,
+                      {ARG_INT, ARG_BUFFER_OUT, ARG_INT}},
+    [SYS_WRITE]    = {"write", sys_write, 3,
+                      {ARG_INT, ARG_BUFFER_IN, ARG_INT}},
+    [SYS_SEEK]     = {"seek", sys_seek, 2, {ARG_INT, ARG_INT}},
+    [SYS_TELL]     = {"tell", sys_tell, 1, {ARG_INT}},
+    [SYS_CLOSE]    = {"close", sys_close, 1, {ARG_INT}},
+    [SYS_CHDIR]    = {"chdir", sys_chdir, 1, {ARG_STRING}},
+    [SYS_MKDIR]    = {"mkdir", sys_mkdir, 1, {ARG_STRING}},
+    [SYS_READDIR]  = {"readdir", sys_readdir, 2, {ARG_INT, ARG_NAME_OUT}},
+    [SYS_ISDIR]    = {"isdir", sys_isdir, 1, {ARG_INT}},
+    [SYS_INUMBER]  = {"inumber", sys_inumber, 1, {ARG_INT}},
+#ifdef VM
+    // the address is checked by mmap itself: it need not be mapped
+    [SYS_MMAP]     = {"mmap", sys_mmap, 2, {ARG_INT, ARG_INT}},
+    [SYS_MUNMAP]   = {"munmap", sys_munmap, 1, {ARG_INT}},
+#endif
+};
+
+#define SYSCALL_CNT ((int) (sizeof syscalls / sizeof *syscalls))
+
+// reads the CPU's time-stamp counter
+static inline uint64_t
+rdtsc (void)
 {
-//  printf ("system call!\n");
-//  thread_exit ();
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
 
+static void
+syscall_handler (struct intr_frame *f) 
+{
     int arg[MAX_ARGS];
-    check_valid_ptr((const void *) f->esp);
+    struct syscall_desc *sc;
+    enum intr_level old_level;
+    uint64_t start, cycles;
+    int nr, i;
+
+#ifdef VM
+    // the stack may need to grow to hold a syscall's buffers, and
+    // whether it may is judged by the user's stack pointer
+    thread_current()->user_esp = f->esp;
+#endif
+    check_valid_buffer(f->esp, sizeof (int), false);
+    nr = * (int *) f->esp;
+#ifdef VM
+    unpin_buffer(f->esp, sizeof (int));
+#endif
+    if (nr < 0 || nr >= SYSCALL_CNT || syscalls[nr].func == NULL)
+        exit(ERROR);
+    sc = &syscalls[nr];
 
-    switch (* (int *) f->esp)
+    // fetch the argument words, then check any that point into
+    // user memory, before the syscall itself runs
+    get_arg(f, &arg[0], sc->argc);
+    for (i = 0; i < sc->argc; i++)
     {
-        case SYS_HALT:
+        switch (sc->kinds[i])
         {
-            halt();
-            break;
+            case ARG_INT:
+                break;
+            case ARG_STRING:
+                check_valid_string((const char *) arg[i]);
+                break;
+            case ARG_BUFFER_IN:
+            case ARG_BUFFER_OUT:
+                ASSERT(i + 1 < sc->argc);
+                check_valid_buffer((const void *) arg[i], (unsigned) arg[i + 1],
+                                   sc->kinds[i] == ARG_BUFFER_OUT);
+                break;
+            case ARG_NAME_OUT:
+                check_valid_buffer((const void *) arg[i], READDIR_MAX_LEN + 1,
+                                   true);
+                break;
         }
+    }
 
-        case SYS_EXIT:
-        {
-            get_arg(f, &arg[0], 1);
-            exit(arg[0]);
-            break;
-        }
+    // count the call up front, since exit and halt never return
+    old_level = intr_disable();
+    sc->cnt++;
+    intr_set_level(old_level);
 
-        case SYS_EXEC:
-        {
-            get_arg(f, &arg[0], 1);
-            arg[0] = UK_pointer((const void *) arg[0]);
-            f->eax = exec((const char *) arg[0]);
-            break;
-        }
+    start = rdtsc();
+    f->eax = sc->func(arg);
+    cycles = rdtsc() - start;
 
-        case SYS_WAIT:
+#ifdef VM
+    // the user memory the syscall used may be evicted again
+    for (i = 0; i < sc->argc; i++)
+    {
+        switch (sc->kinds[i])
         {
-            get_arg(f, &arg[0], 1);
-            f->eax = wait(arg[0]);
-            break;
+            case ARG_INT:
+                break;
+            case ARG_STRING:
+                unpin_buffer((const char *) arg[i],
+                             strlen((const char *) arg[i]) + 1);
+                break;
+            case ARG_BUFFER_IN:
+            case ARG_BUFFER_OUT:
+                unpin_buffer((const void *) arg[i], (unsigned) arg[i + 1]);
+                break;
+            case ARG_NAME_OUT:
+                unpin_buffer((const void *) arg[i], READDIR_MAX_LEN + 1);
+                break;
         }
+    }
+#endif
 
-        case SYS_CREATE:
-        {
-            get_arg(f, &arg[0], 2);
-            arg[0] = UK_pointer((const void *) arg[0]);
-            f->eax = create((const char *) arg[0], (unsigned) arg[1]);
-            break;
-        }
+    old_level = intr_disable();
+    sc->cycles += cycles;
+    if (cycles > sc->max_cycles)
+        sc->max_cycles = cycles;
+    intr_set_level(old_level);
+}
 
-        case SYS_REMOVE:
-        {
-            get_arg(f, &arg[0], 1);
-            arg[0] = UK_pointer((const void *) arg[0]);
-            f->eax = remove((const char *) arg[0]);
-            break;
-        }
+// prints the count and latency of each syscall that was used
+void
+syscall_print_stats (void)
+{
+    int nr;
 
-        case SYS_OPEN:
-        {
-            get_arg(f, &arg[0], 1);
-            arg[0] = UK_pointer((const void *) arg[0]);
-            f->eax = open((const char *) arg[0]);
-            break;
-        }
+    for (nr = 0; nr < SYSCALL_CNT; nr++)
+    {
+        struct syscall_desc *sc = &syscalls[nr];
+        if (sc->cnt > 0)
+            printf ("Syscall: %s: %llu calls, %llu cycles, %llu max cycles\n",
+                    sc->name, sc->cnt, sc->cycles, sc->max_cycles);
+    }
+}
 
-        case SYS_FILESIZE:
-        {
-            get_arg(f, &arg[0], 1);
-            f->eax = filesize(arg[0]);
-            break;
-        }
+static int sys_halt (int *arg UNUSED)
+{
+    halt();
+    NOT_REACHED();
+}
 
-        case SYS_READ:
-        {
-            get_arg(f, &arg[0], 3);
-            check_valid_buffer((void *) arg[1], (unsigned) arg[2]);
-            arg[1] = UK_pointer((const void *) arg[1]);
-            f->eax = read(arg[0], (void *) arg[1], (unsigned) arg[2]);
-            break;
-        }
+static int sys_exit (int *arg)
+{
+    exit(arg[0]);
+    NOT_REACHED();
+}
 
-        case SYS_WRITE:
-        {
-            get_arg(f, &arg[0], 3);
-            check_valid_buffer((void *) arg[1], (unsigned) arg[2]); 
-            arg[1] = UK_pointer((const void *) arg[1]);
-            f->eax = write(arg[0], (const void *) arg[1], (unsigned) arg[2]);
-            break;
-        }
+static int sys_exec (int *arg)
+{
+    return exec((const char *) arg[0]);
+}
 
-        case SYS_SEEK:
-        {
-            get_arg(f, &arg[0], 2);
-            seek(arg[0], (unsigned) arg[1]);
-            break;
-        }
+static int sys_wait (int *arg)
+{
+    return wait(arg[0]);
+}
 
-        case SYS_TELL:
-        {
-            get_arg(f, &arg[0], 1);
-            f->eax = tell(arg[0]);
-            break;
-        }
+static int sys_create (int *arg)
+{
+    return create((const char *) arg[0], (unsigned) arg[1]);
+}
 
-        case SYS_CLOSE:
-        {
-            get_arg(f, &arg[0], 1);
-            close(arg[0]);
-            break;
-        }
-    }
+static int sys_remove (int *arg)
+{
+    return remove((const char *) arg[0]);
 }
 
+static int sys_open (int *arg)
+{
+    return open((const char *) arg[0]);
+}
+
+static int sys_filesize (int *arg)
+{
+    return filesize(arg[0]);
+}
+
+static int sys_read (int *arg)
+{
+    return read(arg[0], (void *) arg[1], (unsigned) arg[2]);
+}
+
+static int sys_write (int *arg)
+{
+    return write(arg[0], (const void *) arg[1], (unsigned) arg[2]);
+}
+
+static int sys_seek (int *arg)
+{
+    seek(arg[0], (unsigned) arg[1]);
+    return 0;
+}
+
+static int sys_tell (int *arg)
+{
+    return tell(arg[0]);
+}
+
+static int sys_close (int *arg)
+{
+    close(arg[0]);
+    return 0;
+}
+
+static int sys_chdir (int *arg)
+{
+    return chdir((const char *) arg[0]);
+}
+
+static int sys_mkdir (int *arg)
+{
+    return mkdir((const char *) arg[0]);
+}
+
+static int sys_readdir (int *arg)
+{
+    return readdir(arg[0], (char *) arg[1]);
+}
+
+static int sys_isdir (int *arg)
+{
+    return isdir(arg[0]);
+}
+
+static int sys_inumber (int *arg)
+{
+    return inumber(arg[0]);
+}
+
+#ifdef VM
+static int sys_mmap (int *arg)
+{
+    return mmap(arg[0], (void *) arg[1]);
+}
+
+static int sys_munmap (int *arg)
+{
+    munmap(arg[0]);
+    return 0;
+}
+#endif
+
 void halt (void)
 {
     shutdown_power_off();
@@ -167,9 +387,9 @@ void halt (void)
 void exit (int status)
 {
     struct thread *cur = thread_current();
-      
-    if (thread_alive(cur->parent))
-            cur->cp->status = status;
+
+    if (cur->cp)
+        cur->cp->status = status;
 
 
     printf ("%s: exit(%d)\n", cur->name, status);
@@ -179,17 +399,16 @@ void exit (int status)
 pid_t exec (const char *cmd_line)
 {
     pid_t pid = process_execute(cmd_line);
+    if (pid == TID_ERROR)
+        return ERROR;
 
     struct child_process *cp = getchild(pid);
-    
+
     ASSERT(cp);
 
-    while (cp->load == NOT_LOADED)
-    {
-        // block thread
-        barrier();
-    }
-    
+    // sleep until the child has finished loading, one way or another
+    sema_down(&cp->load_sema);
+
     if(cp->load == LOAD_FAIL)
         return ERROR;
 
@@ -203,51 +422,33 @@ int wait (pid_t pid)
 
 bool create (const char *file, unsigned init_size)
 {
-    lock_acquire(&filesys_lock);
-    bool success = filesys_create(file, init_size);
-    lock_release(&filesys_lock);
-    return success;
+    return filesys_create(file, init_size);
 }
 
 bool remove (const char *file)
 {
-    lock_acquire(&filesys_lock);    
-    bool success = filesys_remove(file);
-    lock_release(&filesys_lock);
-    return success;    
+    return filesys_remove(file);
 }
 
 int open (const char *file)
 {
-    lock_acquire(&filesys_lock);
-    
     struct file *f = filesys_open(file);
     if (!f)
-    {
-        lock_release(&filesys_lock);
         return ERROR;
-    }
 
     int fd = newfile(f);
-    lock_release(&filesys_lock);
-
+    if (fd == ERROR)
+        file_close(f);
     return fd;
 }
 
 int filesize(int fd)
 {
-    lock_acquire(&filesys_lock);
     struct file *f = getfile(fd);
-
     if (!f)
-    {
-        lock_release(&filesys_lock);
         return ERROR;
-    }
- 
-    int size = file_length(f);
-    lock_release(&filesys_lock);
-    return size;
+
+    return file_length(f);
 }
 
 int read (int fd, void *buffer, unsigned size)
@@ -261,22 +462,12 @@ int read (int fd, void *buffer, unsigned size)
         
         return size;
     }
-    
-    lock_acquire(&filesys_lock);
 
     struct file *f = getfile(fd);
-
-    if(!f)
-    {
-        lock_release(&filesys_lock);
+    if (!f || isdir(fd))
         return ERROR;
-    }
-
-    int bytes = file_read(f, buffer, size);
 
-    lock_release(&filesys_lock);
-
-    return bytes;
+    return file_read(f, buffer, size);
 }
 
 int write (int fd, const void *buffer, unsigned size)
@@ -287,140 +478,319 @@ int write (int fd, const void *buffer, unsigned size)
         return size;
     }
 
-    lock_acquire(&filesys_lock);
-    
     struct file *f = getfile(fd);
-
-    if (!f)
-    {
-        lock_release(&filesys_lock);
+    if (!f || isdir(fd))
         return ERROR;
-    }
-
-    int bytes = file_write(f, buffer, size);
 
-    lock_release(&filesys_lock);
-
-    return bytes;
+    return file_write(f, buffer, size);
 }
 
 void seek (int fd, unsigned position)
 {
-    lock_acquire(&filesys_lock);
-
     struct file *f = getfile(fd);
-    
     if(!f)
-    {
-        lock_release(&filesys_lock);
         return;
-    }
 
     file_seek(f, position);
-
-    lock_release(&filesys_lock);
 }
 
 unsigned tell (int fd)
 {
-    lock_acquire(&filesys_lock);
+    struct file *f = getfile(fd);
+    if (!f)
+        return ERROR;
+
+    return file_tell(f);
+}
+
+void close (int fd)
+{
+    byefile(fd);
+}
 
+bool chdir (const char *dir)
+{
+    return filesys_chdir(dir);
+}
+
+bool mkdir (const char *dir)
+{
+    return filesys_mkdir(dir);
+}
+
+// reads the next entry of the directory open as fd into name.  the
+// fd's file position is the index of the next entry to look at, so
+// successive calls walk the directory
+bool readdir (int fd, char name[READDIR_MAX_LEN + 1])
+{
     struct file *f = getfile(fd);
+    if (!f || !isdir(fd))
+        return false;
 
+    struct dir *dir = dir_open(inode_reopen(file_get_inode(f)));
+    if (!dir)
+        return false;
+
+    dir_seek(dir, file_tell(f));
+    bool success = dir_readdir(dir, name);
+    file_seek(f, dir_tell(dir));
+    dir_close(dir);
+    return success;
+}
+
+bool isdir (int fd)
+{
+    struct file *f = getfile(fd);
+    return f && inode_is_dir(file_get_inode(f));
+}
+
+int inumber (int fd)
+{
+    struct file *f = getfile(fd);
     if (!f)
-    {
-        lock_release(&filesys_lock);
         return ERROR;
+
+    return inode_get_inumber(file_get_inode(f));
+}
+
+#ifdef VM
+static void release_mapping (struct mapping *m);
+
+// maps the file open as fd into memory at page-aligned addr; its
+// pages are read in as they are touched.  fails for an empty file,
+// or if any page in the range is already in use
+mapid_t mmap (int fd, void *addr)
+{
+    struct thread *t = thread_current();
+    struct file *f = getfile(fd);
+    struct mapping *m;
+    off_t length, ofs;
+
+    if (!f || addr == NULL || pg_ofs(addr) != 0)
+        return MAP_FAILED;
+    length = file_length(f);
+    if (length == 0)
+        return MAP_FAILED;
+
+    m = malloc(sizeof *m);
+    if (!m)
+        return MAP_FAILED;
+    m->file = file_reopen(f);
+    if (!m->file)
+    {
+        free(m);
+        return MAP_FAILED;
     }
+    m->addr = addr;
+    m->page_cnt = 0;
 
-   
-    off_t offset = file_tell(f);
+    // page_add_mmap refuses pages that are already reserved, which
+    // catches overlap with code, data, stack and other mappings
+    for (ofs = 0; ofs < length; ofs += PGSIZE)
+    {
+        uint8_t *upage = m->addr + ofs;
+        uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+        if (!is_user_vaddr(upage) || (void *) upage < USER_VADDR_BOTTOM
+            || !page_add_mmap(upage, m->file, ofs, read_bytes))
+        {
+            release_mapping(m);
+            return MAP_FAILED;
+        }
+        m->page_cnt++;
+    }
 
-    lock_release(&filesys_lock);
+    m->id = t->next_mapid++;
+    list_push_back(&t->mapping_list, &m->elem);
+    return m->id;
+}
 
-    return offset;
+void munmap (mapid_t mapping)
+{
+    byemapping(mapping);
 }
 
-void close (int fd)
+// removes the pages of m, writing back the ones that were modified,
+// and frees m, which must not be on a mapping list
+static void release_mapping (struct mapping *m)
 {
-    lock_acquire(&filesys_lock);
-    byefile(fd);
-    lock_release(&filesys_lock);
+    int i;
+
+    for (i = 0; i < m->page_cnt; i++)
+        page_remove(m->addr + i * PGSIZE);
+    file_close(m->file);
+    free(m);
 }
 
+// unmaps mapid, or every mapping for CLOSE_ALL
+void byemapping (int mapid)
+{
+    struct list *mappings = &thread_current()->mapping_list;
+    struct list_elem *e, *next;
+
+    for (e = list_begin(mappings); e != list_end(mappings); e = next)
+    {
+        struct mapping *m = list_entry(e, struct mapping, elem);
+
+        next = list_next(e);
+        if (mapid == CLOSE_ALL || m->id == mapid)
+        {
+            list_remove(&m->elem);
+            release_mapping(m);
+        }
+    }
+}
+#endif
+
 void check_valid_ptr (const void *vaddr)
 {
     if (!is_user_vaddr(vaddr) || vaddr < USER_VADDR_BOTTOM)
         exit(ERROR);
 }
 
-int UK_pointer(const void *vaddr)
+// validates that every page of the size-byte user buffer is mapped,
+// and writable if the kernel is going to write into it, so that the
+// syscall can then access the buffer in place; costs one page table
+// lookup per page rather than a check per byte.  with VM the pages
+// are also pinned, and must be released with unpin_buffer
+void check_valid_buffer (const void *buffer, unsigned size, bool writable)
 {
-    check_valid_ptr(vaddr);
-
-    void *ptr = pagedir_get_page(thread_current()->pagedir, vaddr);
-    if (!ptr)
+#ifndef VM
+    uint32_t *pd = thread_current()->pagedir;
+#endif
+    const uint8_t *start = buffer;
+    const uint8_t *end = start + size;
+    const uint8_t *upage;
+
+    if (size == 0)
+        return;
+    if (end < start)
         exit(ERROR);
 
-    return (int) ptr;
+    for (upage = pg_round_down(start); upage < end; upage += PGSIZE)
+    {
+        const uint8_t *addr = upage < start ? start : upage;
+
+        check_valid_ptr(addr);
+#ifdef VM
+        // bring the page in if need be, growing the stack if that's
+        // where it is, and pin it, so that it can't be evicted while
+        // the syscall uses it
+        if (!page_pin(upage, writable)
+            && !(page_grow_stack(addr, thread_current()->user_esp)
+                 && page_pin(upage, writable)))
+            exit(ERROR);
+#else
+        if (!pagedir_get_page(pd, upage)
+            || (writable && !pagedir_is_writable(pd, upage)))
+            exit(ERROR);
+#endif
+    }
 }
 
-int newfile (struct file *f)
+#ifdef VM
+// unpins the pages of a buffer that check_valid_buffer pinned
+void unpin_buffer (const void *buffer, unsigned size)
 {
-   struct process_file *pf = malloc(sizeof(struct process_file));
-   pf->file = f;
-   pf->fd = thread_current()->fd;
-   thread_current()->fd++;
-   list_push_back(&thread_current()->files, &pf->elem);
-   return pf->fd;
+    const uint8_t *start = buffer;
+    const uint8_t *upage;
+
+    if (size == 0)
+        return;
+    for (upage = pg_round_down(start); upage < start + size; upage += PGSIZE)
+        page_unpin(upage);
 }
+#endif
 
-struct file* getfile (int fd)
+// validates the user string str, page by page, up to and including
+// its null terminator
+void check_valid_string (const char *str)
+{
+    for (;;)
+    {
+        const char *page_end = (const char *) pg_round_down(str) + PGSIZE;
+
+        check_valid_buffer(str, 1, false);
+        for (; str < page_end; str++)
+            if (*str == '\0')
+                return;
+    }
+}
+
+// installs f in the lowest free slot of the fd table, growing the
+// table if it is full; returns the new fd, or ERROR if out of memory
+int newfile (struct file *f)
 {
     struct thread *t = thread_current();
-    struct list_elem *e;
+    int fd = t->fd_low;
+
+    while (fd < t->fd_cap && t->fd_table[fd] != NULL)
+        fd++;
 
-    for (e = list_begin (&t->files); e != list_end (&t->files); e = list_next(e))
+    if (fd >= t->fd_cap)
     {
-        struct process_file *pf = list_entry (e, struct process_file, elem);
-        if (fd == pf->fd)
-            return pf->file;
+        int new_cap = t->fd_cap ? t->fd_cap * 2 : FD_TABLE_INIT;
+        struct file **table = realloc(t->fd_table, new_cap * sizeof *table);
+        if (!table)
+            return ERROR;
+        memset(table + t->fd_cap, 0, (new_cap - t->fd_cap) * sizeof *table);
+        t->fd_table = table;
+        t->fd_cap = new_cap;
     }
 
-    return NULL;
+    t->fd_table[fd] = f;
+    t->fd_low = fd + 1;
+    return fd;
+}
+
+struct file* getfile (int fd)
+{
+    struct thread *t = thread_current();
+
+    if (fd < 0 || fd >= t->fd_cap)
+        return NULL;
+    return t->fd_table[fd];
 }
 
+// closes fd, or every open fd (and frees the table) for CLOSE_ALL
 void byefile (int fd)
 {
     struct thread *t = thread_current();
-    struct list_elem *next, *e = list_begin(&t->files);
 
-    while (e != list_end (&t->files))
+    if (fd == CLOSE_ALL)
     {
-        next = list_next(e);
-        struct process_file *pf = list_entry (e, struct process_file, elem);
-        if (fd == pf->fd || fd == CLOSE_ALL)
-        {
-            file_close(pf->file);
-            list_remove(&pf->elem);
-            free(pf);
-            if (fd != CLOSE_ALL)
-                return;
+        for (fd = 0; fd < t->fd_cap; fd++)
+            file_close(t->fd_table[fd]);
+        free(t->fd_table);
+        t->fd_table = NULL;
+        t->fd_cap = 0;
+        return;
+    }
 
-        }
+    struct file *f = getfile(fd);
+    if (!f)
+        return;
 
-        e = next;
-    }
+    file_close(f);
+    t->fd_table[fd] = NULL;
+    if (fd < t->fd_low)
+        t->fd_low = fd;
 }
 
 struct child_process* newchild (int pid)
 {
-    struct child_process *cp = malloc(sizeof(struct child_process));
+    struct child_process *cp = kmem_cache_alloc(child_process_cache);
+    if (!cp)
+        return NULL;
     cp->pid = pid;
     cp->load = NOT_LOADED;
     cp->wait = false;
     cp->exit = false;
+    cp->status = ERROR;
+    cp->ref_cnt = 2;
     lock_init(&cp->wait_lock);
+    sema_init(&cp->load_sema, 0);
+    sema_init(&cp->exit_sema, 0);
     list_push_back(&thread_current()->child_list, &cp->elem);
     return cp;
 }
@@ -440,10 +810,21 @@ struct child_process* getchild (int pid)
     return NULL;
 }
 
+// drops one reference to cp, freeing it if that was the last one
+void releasechild (struct child_process *cp)
+{
+    lock_acquire(&cp->wait_lock);
+    int ref_cnt = --cp->ref_cnt;
+    lock_release(&cp->wait_lock);
+
+    if (ref_cnt == 0)
+        kmem_cache_free(child_process_cache, cp);
+}
+
 void byechild (struct child_process *cp)
 {
     list_remove(&cp->elem);
-    free(cp);
+    releasechild(cp);
 }
 
 void byechildren (void)
@@ -456,8 +837,7 @@ void byechildren (void)
         next = list_next(e);
         struct child_process *cp = list_entry (e, struct child_process, elem);
 
-        list_remove(&cp->elem);
-        free(cp);
+        byechild(cp);
         e = next;
     }
 }
@@ -471,24 +851,15 @@ void get_arg (struct intr_frame *f, int *arg, int n)
     for (i = 0;i < n; ++i)
     {
         ptr = (int *) f->esp + i + 1;
-        check_valid_ptr((const void *) ptr);
+        check_valid_buffer((const void *) ptr, sizeof *ptr, false);
         arg[i] = *ptr;
+#ifdef VM
+        unpin_buffer((const void *) ptr, sizeof *ptr);
+#endif
     }
 }
 
 
 
-void check_valid_buffer (void* buffer, unsigned size)
-{
-	unsigned i;
-    char* local_buffer = (char *) buffer;
-    for (i = 0; i < size; ++i)
-    {
-        check_valid_ptr((const void*) local_buffer);
-        local_buffer++;
-    }
-}
-
-
 
 
@@ -10,23 +10,33 @@
 #define LOAD_SUCCESS 1
 #define LOAD_FAIL 2
 
+// shared by a parent and one of its children; freed by whichever
+// of the two lets go of it last, so they can exit in either order
 struct child_process {
     int pid;
     int load;
     bool wait;
     bool exit;
     int status;
-    struct lock wait_lock;
+    int ref_cnt;                    // parent + child references left
+    struct lock wait_lock;          // protects ref_cnt
+    struct semaphore load_sema;     // upped once load is decided
+    struct semaphore exit_sema;     // upped when the child exits
     struct list_elem elem;
 };
 
 struct child_process* newchild (int pid);
 struct child_process* getchild (int pid);
+void releasechild (struct child_process *cp);
 void byechild (struct child_process *cp);
 void byechildren (void);
 
 void byefile (int fd);
+#ifdef VM
+void byemapping (int mapid);
+#endif
 
 void syscall_init (void);
+void syscall_print_stats (void);
 
 #endif /* userprog/syscall.h */
@@ -0,0 +1,253 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "vm/page.h"
+
+/* Frame table.
+
+   Every frame that holds a user page is on frame_list.  When the
+   user pool is exhausted, frame_alloc() picks a victim with the
+   "clock" (second chance) algorithm: a hand sweeps around
+   frame_list, and a frame whose pages have been accessed since the
+   hand last passed gets their accessed bits cleared and is
+   skipped; the first frame that has not been accessed is evicted.
+   Frames with a pinned page are always skipped.
+
+   Frames holding read-only executable pages are also entered in
+   the share table, so that a process that needs the same page of
+   the same executable maps the existing frame instead of reading
+   another copy.  A frame stays in the share table until the last
+   page that maps it is removed or it is evicted.
+
+   The zero frame, which all untouched zero pages map, is not in
+   the frame table at all: it is never evicted or freed.
+
+   The frame table has no lock of its own.  All of its functions
+   must be called with the paging lock held (see page.c). */
+
+/* All frames in use, in clock order. */
+static struct list frame_list;
+
+/* Clock hand: the next frame to consider for eviction, or
+   list_end (&frame_list). */
+static struct list_elem *clock_hand;
+
+/* Shared frames, keyed on inode and offset. */
+static struct hash share_table;
+
+/* Frame of zeros, shared by zero pages until they are written. */
+static struct frame zero_frame;
+
+/* Cache from which frame table entries are allocated. */
+static struct kmem_cache *frame_cache;
+
+static struct frame *choose_victim (void);
+static bool evict (struct frame *);
+static void unshare (struct frame *);
+static hash_hash_func frame_hash;
+static hash_less_func frame_less;
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frame_list);
+  clock_hand = list_end (&frame_list);
+  if (!hash_init (&share_table, frame_hash, frame_less, NULL))
+    PANIC ("frame: share table creation failed");
+  frame_cache = kmem_cache_create ("frame", sizeof (struct frame), NULL);
+
+  zero_frame.kpage = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  list_init (&zero_frame.pages);
+  zero_frame.inode = NULL;
+}
+
+/* Obtains a frame, evicting the pages in another frame if the user
+   pool is exhausted.  The frame is returned with no pages mapping
+   it and not shared.  Returns a null pointer if no frame can be
+   freed. */
+struct frame *
+frame_alloc (void)
+{
+  struct frame *f;
+  void *kpage;
+
+  kpage = palloc_get_page (PAL_USER);
+  if (kpage != NULL)
+    {
+      f = kmem_cache_alloc (frame_cache);
+      if (f == NULL)
+        {
+          palloc_free_page (kpage);
+          return NULL;
+        }
+      f->kpage = kpage;
+      list_push_back (&frame_list, &f->elem);
+    }
+  else
+    {
+      f = choose_victim ();
+      if (f == NULL || !evict (f))
+        return NULL;
+      unshare (f);
+    }
+
+  list_init (&f->pages);
+  f->inode = NULL;
+  return f;
+}
+
+/* Removes frame F from the frame table and frees its memory.  No
+   page may map F any longer. */
+void
+frame_free (struct frame *f)
+{
+  ASSERT (list_empty (&f->pages));
+  ASSERT (f != &zero_frame);
+
+  unshare (f);
+  if (clock_hand == &f->elem)
+    clock_hand = list_next (clock_hand);
+  list_remove (&f->elem);
+  palloc_free_page (f->kpage);
+  kmem_cache_free (frame_cache, f);
+}
+
+/* Returns the zero frame.  It must only be mapped read-only. */
+struct frame *
+frame_zero (void)
+{
+  return &zero_frame;
+}
+
+/* Returns the shared frame that holds the page at offset OFS in
+   INODE, or a null pointer if there is none. */
+struct frame *
+frame_find_shared (struct inode *inode, off_t ofs)
+{
+  struct frame f;
+  struct hash_elem *e;
+
+  f.inode = inode;
+  f.ofs = ofs;
+  e = hash_find (&share_table, &f.hash_elem);
+  return e != NULL ? hash_entry (e, struct frame, hash_elem) : NULL;
+}
+
+/* Enters frame F, which holds the read-only page at offset OFS in
+   INODE, in the share table. */
+void
+frame_share (struct frame *f, struct inode *inode, off_t ofs)
+{
+  ASSERT (f->inode == NULL);
+
+  f->inode = inode;
+  f->ofs = ofs;
+  if (hash_insert (&share_table, &f->hash_elem) != NULL)
+    f->inode = NULL;
+}
+
+/* Removes frame F from the share table, if it is there. */
+static void
+unshare (struct frame *f)
+{
+  if (f->inode != NULL)
+    {
+      hash_delete (&share_table, &f->hash_elem);
+      f->inode = NULL;
+    }
+}
+
+/* Returns the next frame under the clock hand and advances the
+   hand, wrapping around at the end of frame_list. */
+static struct frame *
+clock_next (void)
+{
+  if (clock_hand == list_end (&frame_list))
+    clock_hand = list_begin (&frame_list);
+  ASSERT (clock_hand != list_end (&frame_list));
+
+  struct frame *f = list_entry (clock_hand, struct frame, elem);
+  clock_hand = list_next (clock_hand);
+  return f;
+}
+
+/* Returns true if any page mapping frame F is pinned. */
+static bool
+is_pinned (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (list_entry (e, struct page, frame_elem)->pin_cnt > 0)
+      return true;
+  return false;
+}
+
+/* Returns true if any page mapping frame F has been accessed since
+   the last call, clearing the accessed bits of all of them. */
+static bool
+accessed_recently (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (page_accessed_recently (list_entry (e, struct page, frame_elem)))
+      accessed = true;
+  return accessed;
+}
+
+/* Chooses a frame to evict by the clock algorithm.  Returns a null
+   pointer if every frame is pinned. */
+static struct frame *
+choose_victim (void)
+{
+  size_t i, n = list_size (&frame_list);
+
+  /* Two sweeps suffice: the first clears every accessed bit it
+     passes. */
+  for (i = 0; i < 2 * n; i++)
+    {
+      struct frame *f = clock_next ();
+      if (!is_pinned (f) && !accessed_recently (f))
+        return f;
+    }
+  return NULL;
+}
+
+/* Evicts every page that maps frame F.  Returns true if
+   successful, false if a page could not be saved. */
+static bool
+evict (struct frame *f)
+{
+  while (!list_empty (&f->pages))
+    if (!page_evict (list_entry (list_front (&f->pages),
+                                 struct page, frame_elem)))
+      return false;
+  return true;
+}
+
+/* Returns a hash value for frame E. */
+static unsigned
+frame_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, hash_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->ofs);
+}
+
+/* Returns true if frame A precedes frame B. */
+static bool
+frame_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  const struct frame *fa = hash_entry (a, struct frame, hash_elem);
+  const struct frame *fb = hash_entry (b, struct frame, hash_elem);
+
+  if (fa->inode != fb->inode)
+    return fa->inode < fb->inode;
+  return fa->ofs < fb->ofs;
+}
@@ -0,0 +1,39 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include "filesys/off_t.h"
+
+struct inode;
+
+/* A frame: a page of physical memory from the user pool that
+   holds a user page.
+
+   A frame normally holds a page of a single process, but a
+   read-only page of an executable is shared by every process
+   running that executable.  Such a frame is entered in the share
+   table under the inode and offset it was read from.  Likewise,
+   every zero page that has not been written maps the one zero
+   frame, read-only; that frame comes from the kernel pool. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address. */
+    struct list pages;          /* Pages that map the frame. */
+    struct list_elem elem;      /* Element in frame table. */
+
+    /* For shared frames. */
+    struct inode *inode;        /* Inode read from, or null. */
+    off_t ofs;                  /* Offset in INODE. */
+    struct hash_elem hash_elem; /* Element in share table. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (void);
+struct frame *frame_zero (void);
+void frame_free (struct frame *);
+struct frame *frame_find_shared (struct inode *, off_t);
+void frame_share (struct frame *, struct inode *, off_t);
+
+#endif /* vm/frame.h */
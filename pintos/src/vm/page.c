@@ -0,0 +1,509 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Demand paging.
+
+   Instead of reading every page of an executable into memory
+   before it starts, load() records in the process's supplemental
+   page table where each page's contents are to come from.  The
+   first access to such a page faults, and page_fault() calls
+   page_load() to obtain a frame, fill it, and map it.  When the
+   user pool runs out, the frame table evicts some page, which is
+   simply dropped if it can be reread from its file or is still
+   all zeros, and written to swap otherwise.  Pages of files mapped
+   with mmap are faulted in the same way, but are written back to
+   their files rather than to swap.
+
+   All paging is serialized by paging_lock, which is held while
+   pages are loaded, evicted, pinned or destroyed, including the
+   disk I/O involved.  It also protects the frame table and every
+   process's supplemental page table entries.  Code that holds
+   paging_lock never touches user memory, so it never faults. */
+static struct lock paging_lock;
+
+/* Cache from which supplemental page table entries are allocated. */
+static struct kmem_cache *page_cache;
+
+static bool page_in (struct page *, bool write);
+static bool page_fill (struct page *, uint8_t *kpage);
+static bool page_unshare_zero (struct page *);
+static void page_detach (struct page *);
+static void page_write_back (struct page *);
+static void page_release (struct page *);
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+
+/* Initializes the paging modules. */
+void
+page_init (void)
+{
+  lock_init (&paging_lock);
+  page_cache = kmem_cache_create ("page", sizeof (struct page), NULL);
+  frame_init ();
+}
+
+/* Initializes PAGES as an empty supplemental page table.
+   Returns true if successful, false if memory is not available. */
+bool
+page_table_init (struct hash *pages)
+{
+  return hash_init (pages, page_hash, page_less, NULL);
+}
+
+/* Destroys supplemental page table PAGES, which must belong to the
+   current process, releasing the frames and swap slots its pages
+   occupy.  Must be called before the process's page directory is
+   destroyed. */
+void
+page_table_destroy (struct hash *pages)
+{
+  lock_acquire (&paging_lock);
+  hash_destroy (pages, page_destroy);
+  lock_release (&paging_lock);
+}
+
+/* Returns the current process's supplemental page table entry for
+   the page containing UPAGE, or a null pointer if there is none. */
+struct page *
+page_lookup (const void *upage)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (upage);
+  e = hash_find (&thread_current ()->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Adds to the current process's supplemental page table an entry
+   for UPAGE, with SOURCE and WRITABLE as given.  Returns the new
+   entry, or a null pointer if memory is not available or UPAGE
+   already has an entry. */
+static struct page *
+page_add (void *upage, enum page_source source, bool writable)
+{
+  struct page *p;
+  struct hash_elem *old;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  p = kmem_cache_alloc (page_cache);
+  if (p == NULL)
+    return NULL;
+
+  p->upage = upage;
+  p->owner = thread_current ();
+  p->writable = writable;
+  p->source = source;
+  p->file = NULL;
+  p->ofs = 0;
+  p->read_bytes = 0;
+  p->swap_slot = SWAP_ERROR;
+  p->frame = NULL;
+  p->pin_cnt = 0;
+
+  lock_acquire (&paging_lock);
+  old = hash_insert (&p->owner->pages, &p->hash_elem);
+  lock_release (&paging_lock);
+  if (old != NULL)
+    {
+      kmem_cache_free (page_cache, p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Reserves UPAGE in the current process, to be filled on first
+   access with READ_BYTES bytes read from FILE starting at offset
+   OFS followed by PGSIZE - READ_BYTES zeros.  FILE must stay open
+   as long as the process does.
+   Returns true if successful, false on failure. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes, bool writable)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = page_add (upage, PAGE_FILE, writable);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  return true;
+}
+
+/* Reserves UPAGE in the current process for a writable mapping of
+   READ_BYTES bytes of FILE starting at offset OFS, followed by
+   PGSIZE - READ_BYTES zeros.  The page is read on first access,
+   and changes to its first READ_BYTES bytes are written back to
+   FILE when it is evicted or removed.  FILE must stay open until
+   the page is removed.
+   Returns true if successful, false on failure. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = page_add (upage, PAGE_MMAP, true);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  return true;
+}
+
+/* Reserves UPAGE in the current process, to be filled with zeros
+   on first access.  Returns true if successful, false on failure. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  return page_add (upage, PAGE_ZERO, writable) != NULL;
+}
+
+/* Reserves a zero page to extend the current process's stack down
+   to ADDR, if ADDR looks like a stack access for user stack pointer
+   ESP: no more than 32 bytes below ESP, since PUSHA pushes 32 bytes
+   before it adjusts the stack pointer, and within STACK_MAX bytes
+   of the top of the stack.  Returns true if the page containing
+   ADDR was reserved, false otherwise. */
+bool
+page_grow_stack (const void *addr, const void *esp)
+{
+  if (!is_user_vaddr (addr)
+      || addr < PHYS_BASE - STACK_MAX
+      || (const uint8_t *) addr < (const uint8_t *) esp - 32)
+    return false;
+  return page_add_zero (pg_round_down (addr), true);
+}
+
+/* Removes UPAGE, which must be reserved, from the current process,
+   writing it back to its file first if it is a modified PAGE_MMAP
+   page. */
+void
+page_remove (void *upage)
+{
+  struct page *p;
+
+  lock_acquire (&paging_lock);
+  p = page_lookup (upage);
+  ASSERT (p != NULL);
+  hash_delete (&p->owner->pages, &p->hash_elem);
+  page_release (p);
+  lock_release (&paging_lock);
+}
+
+/* Brings the current process's page containing ADDR into memory
+   and maps it, if it is reserved but not resident.  If WRITE is
+   true, the access that needs the page is a write, so a writable
+   zero page gets a private frame rather than the zero frame; this
+   also handles the write fault on a zero page that maps the zero
+   frame.  Returns true if successful, false if ADDR is not in a
+   reserved page, the page is already resident and usable, or no
+   frame can be had. */
+bool
+page_load (const void *addr, bool write)
+{
+  struct page *p;
+  bool success = false;
+
+  lock_acquire (&paging_lock);
+  p = page_lookup (addr);
+  if (p != NULL)
+    {
+      if (p->frame == NULL)
+        success = page_in (p, write);
+      else if (write && p->writable && p->frame == frame_zero ())
+        success = page_unshare_zero (p);
+    }
+  lock_release (&paging_lock);
+  return success;
+}
+
+/* Makes sure the current process's page containing ADDR is in
+   memory, and writable by the process if WRITE is true, and pins
+   it there so that the kernel can access it without faulting.
+   Returns true if successful, false if ADDR is not in a suitable
+   page or no frame can be had.  Each successful call must be
+   matched by a call to page_unpin(). */
+bool
+page_pin (const void *addr, bool write)
+{
+  struct page *p;
+  bool success = false;
+
+  lock_acquire (&paging_lock);
+  p = page_lookup (addr);
+  if (p != NULL && (p->writable || !write)
+      && (p->frame != NULL || page_in (p, write))
+      && (!write || p->frame != frame_zero () || page_unshare_zero (p)))
+    {
+      p->pin_cnt++;
+      success = true;
+    }
+  lock_release (&paging_lock);
+  return success;
+}
+
+/* Unpins the current process's page containing ADDR, which must
+   have been pinned with page_pin(). */
+void
+page_unpin (const void *addr)
+{
+  struct page *p;
+
+  lock_acquire (&paging_lock);
+  p = page_lookup (addr);
+  ASSERT (p != NULL && p->frame != NULL && p->pin_cnt > 0);
+  p->pin_cnt--;
+  lock_release (&paging_lock);
+}
+
+/* Evicts page P from its frame: unmaps it from its owner, removes
+   it from the frame's page list and, if its contents cannot be
+   recovered from its source, writes them back to its file or to
+   swap.  Returns true if successful, false if swap is full.
+   Called by the frame table with paging_lock held. */
+bool
+page_evict (struct page *p)
+{
+  uint32_t *pd = p->owner->pagedir;
+  bool dirty;
+
+  ASSERT (lock_held_by_current_thread (&paging_lock));
+  ASSERT (p->frame != NULL);
+
+  /* Unmap first, so that the owner cannot modify the page after
+     we look at its dirty bit. */
+  pagedir_clear_page (pd, p->upage);
+  dirty = pagedir_is_dirty (pd, p->upage);
+
+  if (p->source == PAGE_MMAP)
+    page_write_back (p);
+  else if (dirty || p->source == PAGE_SWAP)
+    {
+      size_t slot = swap_out (p->frame->kpage);
+      if (slot == SWAP_ERROR)
+        {
+          pagedir_set_page (pd, p->upage, p->frame->kpage, p->writable);
+          return false;
+        }
+      p->source = PAGE_SWAP;
+      p->swap_slot = slot;
+    }
+
+  list_remove (&p->frame_elem);
+  p->frame = NULL;
+  return true;
+}
+
+/* Returns true if page P has been accessed since the last call,
+   clearing its accessed bit.  Called by the frame table with
+   paging_lock held. */
+bool
+page_accessed_recently (struct page *p)
+{
+  uint32_t *pd = p->owner->pagedir;
+
+  if (!pagedir_is_accessed (pd, p->upage))
+    return false;
+  pagedir_set_accessed (pd, p->upage, false);
+  return true;
+}
+
+/* Obtains a frame for page P and maps it in P's owner.  A
+   read-only page of an executable uses the frame that already holds
+   the same page for another process, if there is one, and a zero
+   page that is not about to be written (as WRITE says) uses the
+   zero frame; otherwise the frame is filled from P's source.
+   Returns true if successful, false if no frame can be had or I/O
+   fails.  paging_lock must be held. */
+static bool
+page_in (struct page *p, bool write)
+{
+  bool shareable = p->source == PAGE_FILE && !p->writable;
+  struct inode *inode = NULL;
+  struct frame *f = NULL;
+  bool writable = p->writable;
+
+  ASSERT (lock_held_by_current_thread (&paging_lock));
+  ASSERT (p->frame == NULL);
+
+  if (p->source == PAGE_ZERO && !write)
+    {
+      f = frame_zero ();
+      writable = false;
+    }
+  else if (shareable)
+    {
+      inode = file_get_inode (p->file);
+      f = frame_find_shared (inode, p->ofs);
+    }
+  if (f == NULL)
+    {
+      f = frame_alloc ();
+      if (f == NULL)
+        return false;
+      if (!page_fill (p, f->kpage))
+        {
+          frame_free (f);
+          return false;
+        }
+      if (shareable)
+        frame_share (f, inode, p->ofs);
+    }
+
+  p->frame = f;
+  list_push_back (&f->pages, &p->frame_elem);
+  if (!pagedir_set_page (p->owner->pagedir, p->upage, f->kpage, writable))
+    {
+      /* Anonymous contents are lost here, but the owner is about
+         to be killed for running out of memory anyway. */
+      page_detach (p);
+      return false;
+    }
+  return true;
+}
+
+/* Gives zero page P, which maps the zero frame, a private zeroed
+   frame that its owner may write.  Returns true if successful,
+   false if no frame can be had.  paging_lock must be held. */
+static bool
+page_unshare_zero (struct page *p)
+{
+  uint32_t *pd = p->owner->pagedir;
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&paging_lock));
+  ASSERT (p->frame == frame_zero () && p->writable);
+
+  f = frame_alloc ();
+  if (f == NULL)
+    return false;
+  memset (f->kpage, 0, PGSIZE);
+
+  pagedir_clear_page (pd, p->upage);
+  page_detach (p);
+  p->frame = f;
+  list_push_back (&f->pages, &p->frame_elem);
+  if (!pagedir_set_page (pd, p->upage, f->kpage, true))
+    {
+      page_detach (p);
+      return false;
+    }
+  return true;
+}
+
+/* Removes page P, which must already be unmapped, from its frame's
+   page list, and frees the frame if no other page maps it. */
+static void
+page_detach (struct page *p)
+{
+  struct frame *f = p->frame;
+
+  list_remove (&p->frame_elem);
+  p->frame = NULL;
+  if (list_empty (&f->pages) && f != frame_zero ())
+    frame_free (f);
+}
+
+/* Fills KPAGE with the contents of page P from P's source.
+   Returns true if successful, false if I/O fails. */
+static bool
+page_fill (struct page *p, uint8_t *kpage)
+{
+  switch (p->source)
+    {
+    case PAGE_FILE:
+    case PAGE_MMAP:
+      if (file_read_at (p->file, kpage, p->read_bytes, p->ofs)
+          != (off_t) p->read_bytes)
+        return false;
+      memset (kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+      break;
+
+    case PAGE_ZERO:
+      memset (kpage, 0, PGSIZE);
+      break;
+
+    case PAGE_SWAP:
+      swap_in (p->swap_slot, kpage);
+      p->swap_slot = SWAP_ERROR;
+      break;
+    }
+  return true;
+}
+
+/* Returns a hash value for page E. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  const struct page *pa = hash_entry (a, struct page, hash_elem);
+  const struct page *pb = hash_entry (b, struct page, hash_elem);
+  return pa->upage < pb->upage;
+}
+
+/* Writes resident PAGE_MMAP page P back to its file, if its owner
+   has modified it.  P must already be unmapped, so that it cannot
+   change while it is written.  paging_lock must be held. */
+static void
+page_write_back (struct page *p)
+{
+  ASSERT (p->source == PAGE_MMAP);
+  ASSERT (p->frame != NULL);
+
+  if (pagedir_is_dirty (p->owner->pagedir, p->upage))
+    file_write_at (p->file, p->frame->kpage, p->read_bytes, p->ofs);
+}
+
+/* Frees page P, which has already been removed from its owner's
+   page table, along with its swap slot, or its frame unless other
+   pages still map it.  Unmaps the frame, so that destroying the
+   page directory does not free it a second time.  paging_lock must be held. */
+static void
+page_release (struct page *p)
+{
+  if (p->frame != NULL)
+    {
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      if (p->source == PAGE_MMAP)
+        page_write_back (p);
+      page_detach (p);
+    }
+  else if (p->source == PAGE_SWAP && p->swap_slot != SWAP_ERROR)
+    swap_free (p->swap_slot);
+  kmem_cache_free (page_cache, p);
+}
+
+/* Frees page E.  Used to destroy a page table. */
+static void
+page_destroy (struct hash_elem *e, void *aux UNUSED)
+{
+  page_release (hash_entry (e, struct page, hash_elem));
+}
@@ -0,0 +1,84 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct thread;
+
+/* Maximum size of a process's stack, in bytes. */
+#define STACK_MAX (8 * 1024 * 1024)
+
+/* Where the contents of a virtual page are when it is not in
+   memory. */
+enum page_source
+  {
+    PAGE_FILE,                  /* In a file, rest zeroed. */
+    PAGE_MMAP,                  /* In a file mapped by mmap. */
+    PAGE_ZERO,                  /* All zeros. */
+    PAGE_SWAP                   /* Anonymous: in a swap slot. */
+  };
+
+/* Supplemental page table entry.
+
+   Describes one page of a process's virtual address space: where
+   its contents come from when it is not in memory, and the frame
+   that holds it when it is.  Each process keeps these in a hash
+   table keyed on UPAGE, so page_fault() can bring in a page that
+   has been reserved but not yet loaded, or that was evicted.
+
+   Once a file or zero page has been modified, it can no longer be
+   restored from its original source; on eviction it becomes an
+   anonymous PAGE_SWAP page and is written to swap.  A PAGE_MMAP
+   page instead has its changes written back to its file, when it
+   is evicted or unmapped.  A read-only PAGE_FILE page can never be
+   modified, so it shares its frame with the same page of every
+   other process running the same executable.  A PAGE_ZERO page
+   maps the shared zero frame read-only until it is first written,
+   when it gets a private frame of its own (copy-on-write). */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    struct thread *owner;       /* Process whose page this is. */
+    bool writable;              /* Writable by the user process? */
+    enum page_source source;    /* Where the contents are. */
+
+    /* For PAGE_FILE and PAGE_MMAP. */
+    struct file *file;          /* File to read. */
+    off_t ofs;                  /* Offset in FILE. */
+    uint32_t read_bytes;        /* Bytes to read; the rest are zeroed. */
+
+    /* For PAGE_SWAP. */
+    size_t swap_slot;           /* Swap slot, if not resident. */
+
+    struct frame *frame;        /* Frame, if resident. */
+    struct list_elem frame_elem; /* Element in frame's page list. */
+    int pin_cnt;                /* Frame never evicted while nonzero. */
+    struct hash_elem hash_elem; /* Element in owner's page table. */
+  };
+
+void page_init (void);
+bool page_table_init (struct hash *);
+void page_table_destroy (struct hash *);
+
+struct page *page_lookup (const void *upage);
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    uint32_t read_bytes, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    uint32_t read_bytes);
+bool page_add_zero (void *upage, bool writable);
+bool page_grow_stack (const void *addr, const void *esp);
+void page_remove (void *upage);
+bool page_load (const void *addr, bool write);
+bool page_pin (const void *addr, bool write);
+void page_unpin (const void *addr);
+
+/* For the frame table. */
+bool page_evict (struct page *);
+bool page_accessed_recently (struct page *);
+
+#endif /* vm/page.h */
@@ -0,0 +1,85 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap space.
+
+   The swap block device is divided into page-sized "slots" of
+   SECTORS_PER_SLOT consecutive sectors.  A bitmap tracks which
+   slots are in use.  Pages evicted from memory that cannot simply
+   be reread from a file are written to a free slot, and read back
+   (freeing the slot) when they are next needed. */
+
+/* Number of sectors per swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Swap device, or a null pointer if there is none. */
+static struct block *swap_device;
+
+/* Slots in use.  Null if there is no swap device. */
+static struct bitmap *swap_map;
+
+/* Protects swap_map. */
+static struct lock swap_lock;
+
+/* Initializes swap space on the swap block device, if there is
+   one.  Without one, swap_out() always fails. */
+void
+swap_init (void)
+{
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    {
+      printf ("swap: no swap device, swapping disabled\n");
+      return;
+    }
+
+  swap_map = bitmap_create (block_size (swap_device) / SECTORS_PER_SLOT);
+  if (swap_map == NULL)
+    PANIC ("swap: bitmap creation failed");
+}
+
+/* Writes the page at KPAGE to a free swap slot and returns the
+   slot's number, or SWAP_ERROR if swap space is full or absent. */
+size_t
+swap_out (const void *kpage)
+{
+  size_t slot;
+
+  if (swap_map == NULL)
+    return SWAP_ERROR;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip_next (swap_map, 1, false);
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_ERROR;
+
+  block_write_multiple (swap_device, slot * SECTORS_PER_SLOT,
+                        SECTORS_PER_SLOT, kpage);
+  return slot;
+}
+
+/* Reads swap slot SLOT into the page at KPAGE and frees the slot. */
+void
+swap_in (size_t slot, void *kpage)
+{
+  block_read_multiple (swap_device, slot * SECTORS_PER_SLOT,
+                       SECTORS_PER_SLOT, kpage);
+  swap_free (slot);
+}
+
+/* Frees swap slot SLOT without reading it. */
+void
+swap_free (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  bitmap_reset (swap_map, slot);
+  lock_release (&swap_lock);
+}